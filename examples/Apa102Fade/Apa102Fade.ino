@@ -0,0 +1,54 @@
+#include <SmoothLedApa102.h>
+#include <SmoothLedPixels.h>
+#include <avr/wdt.h>
+
+// This example fades APA102 or SK9822 LEDs between 3 different colours.
+// These LEDs have separate data and clock lines, connected straight to
+// the SPI pins (data to PA1, clock to PA3), so no CCL or TCB is used.
+// Each LED's 5 bit global current is set from its brightest colour,
+// which gives much finer steps than WS2812 LEDs near black.
+
+#define NUM_LEDS 30
+#define UPDATE_INTERVAL_US 1000 // how long between updates
+uint8_t r = 0x30, g = 0, b = 0; // initial colour
+
+// Each LED requires 3 channels of 5 bytes to store its current and
+// target colours and dithering state.
+SmoothLed::Interpolator interpolators[NUM_LEDS * SmoothLedApa102::ChannelsPerLed];
+SmoothLedApa102 leds(interpolators, NUM_LEDS * SmoothLedApa102::ChannelsPerLed);
+// whole LED access, these LEDs take blue, green then red
+SmoothLedPixels<smoothled::BGR> pixels(leds);
+
+void setup()
+{
+    // initialise all LED values to 0
+    leds.clear();
+
+    leds.begin(SmoothLedApa102::MOSI_PA1_SCK_PA3,
+        2); // SPI clock at F_CPU / 2, use a higher divider for long wires
+}
+
+void loop()
+{
+    unsigned long start = micros();
+
+    // reset hardware watchdog (might be enabled in fuses)
+    wdt_reset();
+
+    if (!leds.isFading())
+    {
+        // set target colours
+        pixels.fillPixels(0, NUM_LEDS, r, g, b);
+        // fade over next 1000 updates (1 second at 1kHz)
+        leds.beginFade(1000);
+
+        // cycle to next colour
+        uint8_t t = r; r = g; g = b; b = t;
+    }
+
+    // update fade and send the global current and dithered & gamma
+    // corrected values to the LEDs
+    leds.update();
+
+    while (micros() - start < UPDATE_INTERVAL_US) {}
+}
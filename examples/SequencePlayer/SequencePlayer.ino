@@ -0,0 +1,59 @@
+#include <SmoothLed.h>
+#include <SmoothLedSequence.h>
+#include <avr/wdt.h>
+
+// This example plays a canned animation stored in flash.  The keyframes
+// are read straight from flash as each fade begins, so a long animation
+// costs no SRAM beyond the interpolators.  Make your own with
+// extras/sequenceCodec.py from a text file of keyframes, one per line:
+// the updates to fade over then every channel's target, e.g.
+//
+//     300  0 64 0  0 0 0  0 0 0  0 0 0
+//
+// for a 0.3s fade of the first of 4 GRB LEDs to red.
+
+#define NUM_LEDS 4
+#define LED_CHANNELS 3
+#define UPDATE_INTERVAL_US 1000 // how long between updates
+
+// red chasing along the strip, then all blue, then off.  Plain const
+// arrays stay in flash on these parts, don't add PROGMEM.
+const uint8_t animation[50] =
+{
+    0x0c, 0x00, 0x2c, 0x01, 0x01, 0x00, 0x40, 0xc9, 0x00, 0x2c, 0x01, 0xc3, 0x00, 0x00, 0x40, 0x86,
+    0x2c, 0x01, 0xc6, 0x00, 0x00, 0x40, 0x83, 0x2c, 0x01, 0xc9, 0x00, 0x01, 0x40, 0x00, 0xe8, 0x03,
+    0x81, 0x00, 0x30, 0x81, 0x00, 0x30, 0x81, 0x03, 0x30, 0x00, 0x00, 0x30, 0xf4, 0x01, 0xcb, 0x00,
+    0x00, 0x00,
+};
+
+SmoothLed::Interpolator interpolators[NUM_LEDS * LED_CHANNELS];
+SmoothLed leds(interpolators, NUM_LEDS * LED_CHANNELS);
+SmoothLedSequence player(leds);
+
+void setup()
+{
+    // initialise all LED values to 0
+    leds.clear();
+
+    leds.begin(
+        SmoothLedCcl::PA7_LUT1, // pin where LED data line is connected
+        SmoothLedCcl::PB1_USART0_ASYNCCH1); // this pin will be an output but is only used for the clock signal
+
+    player.play(animation, true); // loop forever
+}
+
+void loop()
+{
+    unsigned long start = micros();
+
+    // reset hardware watchdog (might be enabled in fuses)
+    wdt_reset();
+
+    // start the next keyframe's fade when the last one has finished
+    player.update();
+
+    // update fade and write dithered & gamma corrected values to LED strip
+    leds.update();
+
+    while (micros() - start < UPDATE_INTERVAL_US) {}
+}
@@ -0,0 +1,101 @@
+#include <SmoothLed.h>
+#include <avr/wdt.h>
+#include <avr/sleep.h>
+
+// This is a version of the SmoothPulse example that uses the built in
+// interrupt driven update.  Each call to updateAsync calculates the next
+// frame into one buffer while the previous frame is still being sent from
+// the other, then returns as soon as the new frame has started sending so
+// the rest of the update interval is free for other work.
+// It only works in SPI mode because it's not currently possible to
+// override megaTinyCore's USART DRE interrupt.
+
+// This example fades WS2812B LEDs between 3 different colours.
+// Interpolation, dithering and gamma correction are employed to
+// ensure a smooth fade at low intensities.
+
+#define NUM_LEDS 8
+#define LED_CHANNELS 4 // use 4 for RGBW strands
+#define UPDATE_INTERVAL_US 1000 // how long between updates
+uint8_t r = 0x30, g = 0, b = 0; // initial colour
+
+// Each LED component (R,G,B) requires 5 bytes of memory to store its current
+// and target colours and its dithering state, plus a byte in each of the
+// two output buffers.
+SmoothLed::Interpolator interpolators[NUM_LEDS * LED_CHANNELS];
+SmoothLed leds(interpolators, NUM_LEDS * LED_CHANNELS);
+uint8_t ledData[2][NUM_LEDS * LED_CHANNELS];
+
+// route the SPI interrupt to SmoothLed
+SMOOTHLED_SPI_ISR()
+
+void setupPeriodicTimer(int microSeconds);
+void waitForTimer();
+
+void setup()
+{
+    // initialise all LED values to 0
+    leds.clear(); 
+    leds.setAsyncBuffers(ledData[0], ledData[1], sizeof(ledData[0]));
+
+    leds.begin(
+        SmoothLedCcl::PA7_LUT1, // pin where LED data line is connected
+        SmoothLedCcl::PA3_SPI0_ASYNCCH0); // this pin will be an output but is only used for the clock signal
+
+    setupPeriodicTimer(UPDATE_INTERVAL_US);
+}
+
+void loop()
+{
+    // wait for 1kHz interval
+    waitForTimer();
+
+    // reset hardware watchdog (might be enabled in fuses)
+    wdt_reset();
+
+    // calculate the next frame and start sending it in the background
+    leds.updateAsync();
+
+    if (!leds.isFading())
+    {
+        // set target colours
+        for (uint8_t i = 0; i < NUM_LEDS; ++i)
+        {
+            leds.setFadeTarget(i * LED_CHANNELS + 0, g);
+            leds.setFadeTarget(i * LED_CHANNELS + 1, r);
+            leds.setFadeTarget(i * LED_CHANNELS + 2, b);
+        }
+        // fade over next 1000 updates (1 second at 1kHz)
+        leds.beginFade(1000);
+
+        // cycle to next colour
+        uint8_t t = r; r = g; g = b; b = t;
+    }
+
+    // other work can be performed here while the LEDs update in the background
+}
+
+void setupPeriodicTimer(int microSeconds)
+{
+    // turn off split mode as per megaTinyCore guide
+    TCA0.SPLIT.CTRLA = 0;
+    TCA0.SPLIT.CTRLESET = TCA_SPLIT_CMD_RESET_gc | 0x03;
+    TCA0.SPLIT.CTRLD = 0;
+
+    // set up periodic timer
+    TCA0.SINGLE.INTCTRL = TCA_SINGLE_OVF_bm;
+    TCA0.SINGLE.PER = (F_CPU * 1e-6 * microSeconds + 15) / 16 - 1; 
+    TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV16_gc | TCA_SINGLE_ENABLE_bm;
+}
+volatile bool wakeup = false;
+ISR(TCA0_OVF_vect)
+{
+    wakeup = true;
+    TCA0.SINGLE.INTFLAGS = TCA_SINGLE_OVF_bm;
+}
+void waitForTimer()
+{
+    while (!wakeup)
+        sleep_mode();
+    wakeup = false;
+}
@@ -1,4 +1,4 @@
-#include <SmoothLed.h>
+#include <SmoothLedMulti.h>
 #include <avr/wdt.h>
 #include <avr/sleep.h>
 
@@ -27,6 +27,7 @@ SmoothLed::Interpolator interpolators0[NUM_LEDS * LED_CHANNELS];
 SmoothLed leds0(interpolators0, NUM_LEDS * LED_CHANNELS);
 SmoothLed::Interpolator interpolators1[NUM_LEDS * LED_CHANNELS];
 SmoothLed leds1(interpolators1, NUM_LEDS * LED_CHANNELS);
+SmoothLedMulti strips(leds0, leds1); // SPI strip first, then USART
 
 void setupPeriodicTimer(int microSeconds);
 void waitForTimer();
@@ -78,22 +79,9 @@ void loop()
         uint8_t t = r; r = g; g = b; b = t;
     }
 
-    // update fade and write dithered & gamma corrected values to LED strips
-    uint8_t deltaTime = leds0.updateTime();
-    uint8_t n = NUM_LEDS * LED_CHANNELS;
-    const uint16_t* gammaLut = leds0.getGammaLut();
-    uint16_t maxValue = leds0.getMaxValue();
-    uint8_t ditherMask = leds0.getDitherMask();
-    SmoothLed::Interpolator* i0 = leds0.getInterpolators();
-    SmoothLed::Interpolator* i1 = leds1.getInterpolators();
-    leds0.beginTransactionSpi();
-    leds1.beginTransactionUsart();
-    do {
-        leds0.writeSpi(i0++->update(deltaTime, gammaLut, maxValue, ditherMask));
-        leds1.writeUsart(i1++->update(deltaTime, gammaLut, maxValue, ditherMask));
-    } while (--n);
-    leds0.endTransactionSpi();
-    leds1.endTransactionUsart();
+    // update fade and write dithered & gamma corrected values to both
+    // LED strips, interleaving the calculation with the output
+    strips.update();
 
     delayMicroseconds(50);
 }
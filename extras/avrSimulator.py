@@ -0,0 +1,608 @@
+"""Small AVRxt (tinyAVR 0/1 series) instruction set simulator.
+
+Only the instructions, addressing modes and directives used by the SmoothLed
+assembly kernels are supported.  Source files are run through the host C
+preprocessor (with a stub <avr/io.h>) so the same .S files that are built by
+the Arduino IDE can be executed and cycle counted on a desktop machine.
+
+Cycle counts follow the AVRxt column of the AVR instruction set manual:
+loads from SRAM take 2 cycles, loads from memory mapped flash take 3 and
+stores take 1.
+"""
+
+import os, re, subprocess, tempfile
+
+SRAM_START = 0x3800
+SRAM_END = 0x4000
+FLASH_START = 0x8000
+
+# I/O register addresses used by the kernels (ATtiny1614 memory map)
+IO_REGISTERS = {
+    'SPI0_CTRLA': 0x0820, 'SPI0_CTRLB': 0x0821, 'SPI0_INTCTRL': 0x0822,
+    'SPI0_INTFLAGS': 0x0823, 'SPI0_DATA': 0x0824,
+    'USART0_RXDATAL': 0x0800, 'USART0_TXDATAL': 0x0802, 'USART0_STATUS': 0x0804,
+}
+IO_BITS = {
+    'USART_DREIF_bp': 5, 'USART_DREIF_bm': 0x20, 'USART_TXCIF_bp': 6, 'USART_TXCIF_bm': 0x40,
+    'SPI_DREIF_bp': 5, 'SPI_DREIF_bm': 0x20, 'SPI_TXCIF_bp': 6, 'SPI_TXCIF_bm': 0x40,
+}
+
+REGISTER_ALIASES = {'XL': 26, 'XH': 27, 'YL': 28, 'YH': 29, 'ZL': 30, 'ZH': 31,
+                    'X': 26, 'Y': 28, 'Z': 30}
+
+
+class SimulatorError(Exception):
+    pass
+
+
+def preprocess(path, defines=None):
+    """Run a .S file through cpp with a stub avr/io.h and return the text."""
+    with tempfile.TemporaryDirectory() as stubdir:
+        os.makedirs(os.path.join(stubdir, 'avr'))
+        with open(os.path.join(stubdir, 'avr', 'io.h'), 'w') as f:
+            for name, value in list(IO_REGISTERS.items()) + list(IO_BITS.items()):
+                f.write('#define %s 0x%04x\n' % (name, value))
+        args = ['cpp', '-P', '-undef', '-x', 'assembler-with-cpp', '-D__AVR__', '-D__ASSEMBLER__',
+                '-I', stubdir, '-I', os.path.dirname(os.path.abspath(path))]
+        for name, value in (defines or {}).items():
+            args.append('-D%s=%s' % (name, value))
+        args.append(path)
+        result = subprocess.run(args, capture_output=True, text=True)
+        if result.returncode != 0:
+            raise SimulatorError(result.stderr)
+        return result.stdout
+
+
+class Instruction:
+    def __init__(self, op, operands, line):
+        self.op = op
+        self.operands = operands
+        self.line = line
+
+
+class Program:
+    """Parsed assembly: a flat instruction list plus symbol and local label tables."""
+
+    def __init__(self, text):
+        self.instructions = []
+        self.symbols = {}
+        self.local_labels = {}   # number -> sorted list of instruction indices
+        self._parse(self._expand_macros(text.splitlines()))
+
+    @staticmethod
+    def _strip(line):
+        return line.split(';', 1)[0].split('//', 1)[0].strip()
+
+    def _expand_macros(self, lines):
+        macros = {}
+        out = []
+        i = 0
+        while i < len(lines):
+            line = self._strip(lines[i])
+            i += 1
+            if line.startswith('.macro'):
+                parts = re.split(r'[\s,]+', line[len('.macro'):].strip())
+                name, params = parts[0], [p for p in parts[1:] if p]
+                body = []
+                while not self._strip(lines[i]).startswith('.endm'):
+                    body.append(lines[i])
+                    i += 1
+                i += 1
+                macros[name] = (params, body)
+                continue
+            m = re.match(r'^((?:(?:[A-Za-z_.$][\w.$]*|\d+):\s*)+)(.*)$', line)
+            if m and m.group(2).split(None, 1)[:1] and m.group(2).split(None, 1)[0] in macros:
+                out.append(m.group(1).strip())
+                line = m.group(2)
+            word = line.split(None, 1)
+            if word and word[0] in macros:
+                params, body = macros[word[0]]
+                args = [a.strip() for a in word[1].split(',')] if len(word) > 1 else []
+                expanded = []
+                for b in body:
+                    for p, a in sorted(zip(params, args), key=lambda pa: -len(pa[0])):
+                        b = b.replace('\\' + p, a)
+                    expanded.append(b)
+                lines[i:i] = expanded
+                continue
+            out.append(line)
+        return out
+
+    def _parse(self, lines):
+        for line in lines:
+            while True:
+                m = re.match(r'^([A-Za-z_.$][\w.$]*|\d+):\s*(.*)$', line)
+                if not m:
+                    break
+                label, line = m.group(1), m.group(2)
+                if label.isdigit():
+                    self.local_labels.setdefault(int(label), []).append(len(self.instructions))
+                else:
+                    self.symbols[label] = len(self.instructions)
+            if not line or line.startswith('.'):
+                continue
+            parts = line.split(None, 1)
+            op = parts[0].lower()
+            operands = [o.strip() for o in parts[1].split(',')] if len(parts) > 1 else []
+            self.instructions.append(Instruction(op, operands, line))
+
+    def resolve_branch(self, target, pc):
+        m = re.match(r'^(\d+)([fb])$', target)
+        if m:
+            n, direction = int(m.group(1)), m.group(2)
+            positions = self.local_labels.get(n, [])
+            if direction == 'f':
+                candidates = [p for p in positions if p > pc]
+                if candidates:
+                    return candidates[0]
+            else:
+                candidates = [p for p in positions if p <= pc]
+                if candidates:
+                    return candidates[-1]
+            raise SimulatorError('unresolved local label %s' % target)
+        if target in self.symbols:
+            return self.symbols[target]
+        raise SimulatorError('unknown label %s' % target)
+
+
+class TxPeripheral:
+    """SPI/USART transmitter with a one byte buffer in front of the shift register."""
+
+    def __init__(self, data_address, status_address, cycles_per_byte, dre_bit=5, txc_bit=6):
+        self.data_address = data_address
+        self.status_address = status_address
+        self.cycles_per_byte = cycles_per_byte
+        self.dre_bit = dre_bit
+        self.txc_bit = txc_bit
+        self.reset()
+
+    def reset(self):
+        self.shift_end = 0
+        self.buffered = None
+        self.written = []      # (cycle the byte started shifting, value)
+        self.overruns = 0
+        self.idle_cycles = 0   # cycles where the shifter had nothing to send after the first byte
+
+    def _advance(self, cycle):
+        if self.buffered is not None and self.shift_end <= cycle:
+            self.written.append((self.shift_end, self.buffered))
+            self.shift_end += self.cycles_per_byte
+            self.buffered = None
+
+    def read(self, address, cycle):
+        self._advance(cycle)
+        status = 0
+        if self.buffered is None:
+            status |= 1 << self.dre_bit
+            if self.shift_end <= cycle:
+                status |= 1 << self.txc_bit
+        return status
+
+    def write(self, address, value, cycle):
+        self._advance(cycle)
+        if self.shift_end <= cycle:
+            if self.written:
+                self.idle_cycles += cycle - self.shift_end
+            self.written.append((cycle, value))
+            self.shift_end = cycle + self.cycles_per_byte
+        elif self.buffered is None:
+            self.buffered = value
+        else:
+            self.overruns += 1
+
+    def finish(self):
+        self._advance(self.shift_end)
+        return self.shift_end
+
+    def values(self):
+        return bytes(v for _, v in self.written)
+
+
+class Machine:
+    def __init__(self, program):
+        self.program = program
+        self.memory = bytearray(0x10000)
+        self.peripherals = {}
+        self.reset()
+
+    def reset(self):
+        self.r = [0] * 32
+        self.flags = dict(C=0, Z=0, N=0, V=0, S=0, H=0, T=0)
+        self.sp = SRAM_END - 1
+        self.cycles = 0
+        self.profile = {}
+
+    def attach(self, peripheral):
+        self.peripherals[peripheral.data_address] = peripheral
+        self.peripherals[peripheral.status_address] = peripheral
+
+    # memory access -----------------------------------------------------------
+
+    def load(self, address):
+        address &= 0xffff
+        p = self.peripherals.get(address)
+        if p is not None:
+            return p.read(address, self.cycles)
+        if address < SRAM_START and address not in self.peripherals and address >= 0x40:
+            raise SimulatorError('read from unmapped address 0x%04x' % address)
+        return self.memory[address]
+
+    def store(self, address, value):
+        address &= 0xffff
+        p = self.peripherals.get(address)
+        if p is not None:
+            p.write(address, value & 0xff, self.cycles)
+            return
+        if not (SRAM_START <= address < SRAM_END) and address >= 0x40:
+            raise SimulatorError('write to non-RAM address 0x%04x' % address)
+        self.memory[address] = value & 0xff
+
+    def write_bytes(self, address, data):
+        self.memory[address:address + len(data)] = bytes(data)
+
+    def read_bytes(self, address, count):
+        return bytes(self.memory[address:address + count])
+
+    # register helpers --------------------------------------------------------
+
+    def pair(self, n):
+        return self.r[n] | (self.r[n + 1] << 8)
+
+    def set_pair(self, n, value):
+        self.r[n] = value & 0xff
+        self.r[n + 1] = (value >> 8) & 0xff
+
+    @staticmethod
+    def reg(name, low=0, high=31):
+        name = name.strip()
+        if name in REGISTER_ALIASES:
+            n = REGISTER_ALIASES[name]
+        else:
+            m = re.match(r'^[rR](\d+)$', name)
+            if not m:
+                raise SimulatorError('bad register %s' % name)
+            n = int(m.group(1))
+        if not (low <= n <= high):
+            raise SimulatorError('register %s not allowed here' % name)
+        return n
+
+    @staticmethod
+    def imm(expr):
+        functions = {'lo8': lambda x: x & 0xff, 'hi8': lambda x: (x >> 8) & 0xff}
+        try:
+            value = eval(expr, {'__builtins__': {}}, functions)
+        except Exception:
+            raise SimulatorError('bad expression %s' % expr)
+        return int(value)
+
+    # flags -------------------------------------------------------------------
+
+    def _nzs(self, result):
+        f = self.flags
+        f['N'] = (result >> 7) & 1
+        f['Z'] = int((result & 0xff) == 0)
+        f['S'] = f['N'] ^ f['V']
+
+    def _add(self, a, b, carry):
+        result = a + b + carry
+        r = result & 0xff
+        self.flags['C'] = int(result > 0xff)
+        self.flags['V'] = int(((a ^ r) & (b ^ r) & 0x80) != 0)
+        self._nzs(r)
+        return r
+
+    def _sub(self, a, b, carry, keep_z=False):
+        result = a - b - carry
+        r = result & 0xff
+        z = self.flags['Z']
+        self.flags['C'] = int(result < 0)
+        self.flags['V'] = int(((a ^ b) & (a ^ r) & 0x80) != 0)
+        self._nzs(r)
+        if keep_z:
+            self.flags['Z'] = int(r == 0 and z)
+        return r
+
+    def _logic(self, r):
+        self.flags['V'] = 0
+        self._nzs(r)
+        return r
+
+    def _multiply(self, a, b, fractional):
+        product = a * b
+        if fractional:
+            self.flags['C'] = (product >> 15) & 1
+            product <<= 1
+        else:
+            self.flags['C'] = (product >> 15) & 1
+        product &= 0xffff
+        self.flags['Z'] = int(product == 0)
+        self.r[0] = product & 0xff
+        self.r[1] = product >> 8
+
+    # pointer addressing --------------------------------------------------------
+
+    def _pointer(self, operand, allow_displacement):
+        operand = operand.replace(' ', '')
+        m = re.match(r'^(-?)([XYZ])(\+?)([\d+*()]*)$', operand)
+        if not m:
+            raise SimulatorError('bad pointer operand %s' % operand)
+        pre, name, post, disp = m.groups()
+        base = REGISTER_ALIASES[name]
+        displacement = 0
+        if disp:
+            if not allow_displacement or name == 'X':
+                raise SimulatorError('displacement not allowed in %s' % operand)
+            displacement = self.imm(disp)
+            if displacement > 63:
+                raise SimulatorError('displacement out of range in %s' % operand)
+        if allow_displacement and not disp:
+            raise SimulatorError('ldd/std need a displacement')
+        address = self.pair(base)
+        if pre:
+            address = (address - 1) & 0xffff
+            self.set_pair(base, address)
+        result = (address + displacement) & 0xffff
+        if post:
+            if disp:
+                return result
+            self.set_pair(base, address + 1)
+        return result
+
+    # execution -----------------------------------------------------------------
+
+    def call(self, name, args=(), max_cycles=10000000, start_cycle=0):
+        """Call a function using the avr-gcc calling convention.
+
+        args is a list of (value, size) tuples allocated from r25 downwards.
+        start_cycle continues the clock of attached peripherals from an
+        earlier call.  Returns the cycle count when the function returns.
+        """
+        self.reset()
+        self.cycles = start_cycle
+        n = 26
+        for value, size in args:
+            n -= size + (size & 1)
+            for i in range(size):
+                self.r[n + i] = (value >> (8 * i)) & 0xff
+        self.r[1] = 0
+        saved = self.r[2:18] + self.r[28:30]
+        pc = self.program.symbols[name]
+        depth = 0
+        instructions = self.program.instructions
+        while True:
+            if self.cycles - start_cycle > max_cycles:
+                raise SimulatorError('cycle limit exceeded')
+            ins = instructions[pc]
+            start = self.cycles
+            next_pc = self.step(ins, pc)
+            self.profile[pc] = self.profile.get(pc, 0) + self.cycles - start
+            if next_pc is None:
+                if depth == 0:
+                    break
+                depth -= 1
+                next_pc = self.pop16()
+            elif next_pc < 0:
+                depth += 1
+                next_pc = -next_pc - 1
+            pc = next_pc
+        if self.r[2:18] + self.r[28:30] != saved:
+            raise SimulatorError('%s did not preserve call-saved registers' % name)
+        if self.r[1] != 0:
+            raise SimulatorError('%s returned with r1 != 0' % name)
+        return self.cycles
+
+    def push(self, value):
+        self.memory[self.sp] = value & 0xff
+        self.sp -= 1
+
+    def pop(self):
+        self.sp += 1
+        return self.memory[self.sp]
+
+    def pop16(self):
+        lo = self.pop()
+        return lo | (self.pop() << 8)
+
+    def step(self, ins, pc):
+        op, o = ins.op, ins.operands
+        r = self.r
+        f = self.flags
+        cycles = 1
+        next_pc = pc + 1
+
+        def branch(condition):
+            nonlocal cycles, next_pc
+            if condition:
+                cycles = 2
+                next_pc = self.program.resolve_branch(o[-1], pc)
+
+        def skip(condition):
+            nonlocal cycles, next_pc
+            if condition:
+                cycles = 2
+                next_pc = pc + 2
+                if instructions_two_words(self.program.instructions[pc + 1]):
+                    cycles = 3
+
+        if op == 'nop':
+            pass
+        elif op in ('add', 'adc'):
+            d, s = self.reg(o[0]), self.reg(o[1])
+            r[d] = self._add(r[d], r[s], f['C'] if op == 'adc' else 0)
+        elif op == 'lsl':
+            d = self.reg(o[0])
+            r[d] = self._add(r[d], r[d], 0)
+        elif op == 'rol':
+            d = self.reg(o[0])
+            r[d] = self._add(r[d], r[d], f['C'])
+        elif op in ('sub', 'sbc', 'cp', 'cpc'):
+            d, s = self.reg(o[0]), self.reg(o[1])
+            carry = f['C'] if op in ('sbc', 'cpc') else 0
+            result = self._sub(r[d], r[s], carry, keep_z=op in ('sbc', 'cpc'))
+            if op in ('sub', 'sbc'):
+                r[d] = result
+        elif op in ('subi', 'sbci', 'cpi'):
+            d = self.reg(o[0], 16)
+            carry = f['C'] if op == 'sbci' else 0
+            result = self._sub(r[d], self.imm(o[1]) & 0xff, carry, keep_z=op == 'sbci')
+            if op != 'cpi':
+                r[d] = result
+        elif op in ('and', 'or', 'eor'):
+            d, s = self.reg(o[0]), self.reg(o[1])
+            if op == 'and':
+                r[d] = self._logic(r[d] & r[s])
+            elif op == 'or':
+                r[d] = self._logic(r[d] | r[s])
+            else:
+                r[d] = self._logic(r[d] ^ r[s])
+        elif op in ('andi', 'ori', 'cbr', 'sbr'):
+            d = self.reg(o[0], 16)
+            k = self.imm(o[1]) & 0xff
+            if op in ('andi', 'cbr'):
+                r[d] = self._logic(r[d] & (k if op == 'andi' else ~k & 0xff))
+            else:
+                r[d] = self._logic(r[d] | k)
+        elif op == 'clr':
+            d = self.reg(o[0])
+            r[d] = self._logic(0)
+        elif op == 'tst':
+            d = self.reg(o[0])
+            self._logic(r[d])
+        elif op == 'ser':
+            r[self.reg(o[0], 16)] = 0xff
+        elif op == 'com':
+            d = self.reg(o[0])
+            r[d] = self._logic(~r[d] & 0xff)
+            f['C'] = 1
+        elif op == 'neg':
+            d = self.reg(o[0])
+            r[d] = self._sub(0, r[d], 0)
+        elif op in ('inc', 'dec'):
+            d = self.reg(o[0])
+            v = (r[d] + (1 if op == 'inc' else -1)) & 0xff
+            f['V'] = int(v == (0x80 if op == 'inc' else 0x7f))
+            r[d] = v
+            self._nzs(v)
+        elif op in ('lsr', 'asr', 'ror'):
+            d = self.reg(o[0])
+            v = r[d]
+            carry_in = {'lsr': 0, 'asr': v & 0x80, 'ror': f['C'] << 7}[op]
+            f['C'] = v & 1
+            v = (v >> 1) | carry_in
+            f['N'] = v >> 7
+            f['Z'] = int(v == 0)
+            f['V'] = f['N'] ^ f['C']
+            f['S'] = f['N'] ^ f['V']
+            r[d] = v
+        elif op == 'swap':
+            d = self.reg(o[0])
+            r[d] = ((r[d] << 4) | (r[d] >> 4)) & 0xff
+        elif op == 'mov':
+            r[self.reg(o[0])] = r[self.reg(o[1])]
+        elif op == 'movw':
+            d, s = self.reg(o[0]), self.reg(o[1])
+            if d & 1 or s & 1:
+                raise SimulatorError('movw needs even registers: %s' % ins.line)
+            r[d], r[d + 1] = r[s], r[s + 1]
+        elif op == 'ldi':
+            r[self.reg(o[0], 16)] = self.imm(o[1]) & 0xff
+        elif op in ('adiw', 'sbiw'):
+            d = self.reg(o[0])
+            if d not in (24, 26, 28, 30):
+                raise SimulatorError('bad adiw/sbiw register: %s' % ins.line)
+            k = self.imm(o[1])
+            if not 0 <= k <= 63:
+                raise SimulatorError('adiw/sbiw immediate out of range: %s' % ins.line)
+            a = self.pair(d)
+            result = a + k if op == 'adiw' else a - k
+            f['C'] = int(result > 0xffff or result < 0)
+            result &= 0xffff
+            f['Z'] = int(result == 0)
+            f['N'] = result >> 15
+            f['V'] = int((op == 'adiw' and not a & 0x8000 and result & 0x8000) or
+                         (op == 'sbiw' and a & 0x8000 and not result & 0x8000))
+            f['S'] = f['N'] ^ f['V']
+            self.set_pair(d, result)
+            cycles = 2
+        elif op in ('mul', 'muls', 'mulsu', 'fmul', 'fmuls', 'fmulsu'):
+            limits = {'mul': (0, 31), 'muls': (16, 31)}.get(op, (16, 23))
+            d, s = self.reg(o[0], *limits), self.reg(o[1], *limits)
+            a, b = r[d], r[s]
+            if op in ('muls', 'mulsu', 'fmuls', 'fmulsu') and a & 0x80:
+                a -= 256
+            if op in ('muls', 'fmuls') and b & 0x80:
+                b -= 256
+            self._multiply(a, b, op.startswith('f'))
+            cycles = 2
+        elif op in ('ld', 'ldd'):
+            d = self.reg(o[0])
+            address = self._pointer(o[1], op == 'ldd')
+            r[d] = self.load(address)
+            cycles = 3 if address >= FLASH_START else 2
+        elif op in ('st', 'std'):
+            address = self._pointer(o[0], op == 'std')
+            self.store(address, r[self.reg(o[1])])
+            cycles = 1
+        elif op == 'lds':
+            d = self.reg(o[0])
+            address = self.imm(o[1])
+            r[d] = self.load(address)
+            cycles = 3
+        elif op == 'sts':
+            self.store(self.imm(o[0]), r[self.reg(o[1])])
+            cycles = 2
+        elif op == 'push':
+            self.push(r[self.reg(o[0])])
+        elif op == 'pop':
+            r[self.reg(o[0])] = self.pop()
+            cycles = 2
+        elif op == 'bst':
+            f['T'] = (r[self.reg(o[0])] >> self.imm(o[1])) & 1
+        elif op in ('set', 'clt'):
+            f['T'] = 1 if op == 'set' else 0
+        elif op == 'bld':
+            d, b = self.reg(o[0]), self.imm(o[1])
+            r[d] = (r[d] & ~(1 << b) & 0xff) | (f['T'] << b)
+        elif op in ('sbrc', 'sbrs'):
+            bit = (r[self.reg(o[0])] >> self.imm(o[1])) & 1
+            skip(bit == (0 if op == 'sbrc' else 1))
+        elif op == 'cpse':
+            d, s = self.reg(o[0]), self.reg(o[1])
+            skip(r[d] == r[s])
+        elif op == 'rjmp':
+            next_pc = self.program.resolve_branch(o[0], pc)
+            cycles = 2
+        elif op == 'rcall':
+            target = self.program.resolve_branch(o[0], pc)
+            self.push((pc + 1) >> 8)
+            self.push(pc + 1)
+            cycles = 2
+            next_pc = -target - 1
+        elif op == 'ret':
+            cycles = 4
+            next_pc = None
+        elif op in BRANCHES:
+            branch(BRANCHES[op](f))
+        else:
+            raise SimulatorError('unsupported instruction: %s' % ins.line)
+        self.cycles += cycles
+        return next_pc
+
+
+def instructions_two_words(ins):
+    return ins.op in ('lds', 'sts', 'call', 'jmp')
+
+
+BRANCHES = {
+    'breq': lambda f: f['Z'], 'brne': lambda f: not f['Z'],
+    'brcs': lambda f: f['C'], 'brlo': lambda f: f['C'],
+    'brcc': lambda f: not f['C'], 'brsh': lambda f: not f['C'],
+    'brmi': lambda f: f['N'], 'brpl': lambda f: not f['N'],
+    'brge': lambda f: not f['S'], 'brlt': lambda f: f['S'],
+    'brvs': lambda f: f['V'], 'brvc': lambda f: not f['V'],
+    'brts': lambda f: f['T'], 'brtc': lambda f: not f['T'],
+}
+
+
+def load(path, defines=None):
+    return Machine(Program(preprocess(path, defines)))
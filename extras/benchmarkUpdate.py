@@ -0,0 +1,894 @@
+"""SmoothLed update kernel verification and benchmark.
+
+Runs the assembly kernels from src/SmoothLedUpdate.S under the instruction
+set simulator in avrSimulator.py and compares every output byte and every
+interpolator against the C++ implementation (SmoothLed::Interpolator::update
+built for the host with SMOOTHLED_ASM_UPDATE=0) over randomized fade
+positions, dither masks, value ranges and gamma tables.  It then reports the
+cycles per byte and per frame of the buffered and 8 cycle per bit kernels,
+compares SmoothLedMulti's fused SPI + USART kernel with updating the two
+strips one after the other, and compares update + setFadeTarget with the
+fused SmoothLedUpdateTargets8cpb at the USART byte rate of each F_CPU.
+
+Requires python 3 and a host g++ (used for both the C preprocessor and the
+reference build).  Example:
+
+    python3 benchmarkUpdate.py --trials 200 --channels 150
+"""
+
+import argparse, ctypes, glob, math, os, random, subprocess, sys, tempfile
+
+import avrSimulator
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SRC = os.path.join(HERE, '..', 'src')
+
+INTERPOLATOR_ADDRESS = 0x3800
+OUTPUT_ADDRESS = 0x3c00
+GAMMA_ADDRESS = 0x8000
+# second strip for SmoothLedUpdateDual, which doesn't use the output buffer
+INTERPOLATOR_B_ADDRESS = OUTPUT_ADDRESS
+GAMMA_B_ADDRESS = 0x8400
+PARAMS_ADDRESS = 0x3f00
+# SMOOTHLED_GAMMA_CHANNELS > 1: table k of a strip is at its gamma address
+# + k * 0x100 and the kernels get lists of table pointers in SRAM
+GAMMA_LIST_ADDRESS = 0x3f80
+# SmoothLedApa102Scale, a C++ table the APA102 kernel reads from flash
+APA102_SCALE_ADDRESS = 0x8c00
+APA102_BYTE_CYCLES = 16   # SPI clock at F_CPU / 2
+# SMOOTHLED_SPI_ISR per byte sent by updateAsync: vector, prologue, the data
+# register empty branch of SmoothLedCcl::handleSpiInterrupt, epilogue and
+# reti.  The handler is C++, so this is counted by hand rather than simulated.
+ASYNC_ISR_CYCLES = 64
+# SmoothLed::KernelTargetsChunk, channels per SmoothLedUpdateTargets8cpb call
+TARGETS_CHUNK = 252
+DITHER_MASKS = [0x00, 0x80, 0xc0, 0xe0, 0xf0, 0xf8, 0xfc, 0xfe, 0xff]
+
+REFERENCE_SHIM = r'''
+#define SMOOTHLED_HOST_PERIPHERALS
+#include "SmoothLedApa102.h"
+
+// state is in the packed AVR layout of SmoothLed::Interpolator
+#if SMOOTHLED_COMPACT_INTERPOLATOR
+static const uint8_t StateSize = 4;
+static void loadState(SmoothLed::Interpolator& i, const uint8_t* state)
+{
+    i.step = int8_t(state[0]);
+    i.value = int16_t(state[1] | (state[2] << 8));
+    i.dither = state[3];
+}
+static void storeState(const SmoothLed::Interpolator& i, uint8_t* state)
+{
+    state[0] = i.step;
+    state[1] = lowByte(i.value); state[2] = highByte(i.value);
+    state[3] = i.dither;
+}
+#else
+static const uint8_t StateSize = 5;
+static void loadState(SmoothLed::Interpolator& i, const uint8_t* state)
+{
+    i.step = int16_t(state[0] | (state[1] << 8));
+    i.value = int16_t(state[2] | (state[3] << 8));
+    i.dither = state[4];
+}
+static void storeState(const SmoothLed::Interpolator& i, uint8_t* state)
+{
+    state[0] = lowByte(i.step); state[1] = highByte(i.step);
+    state[2] = lowByte(i.value); state[3] = highByte(i.value);
+    state[4] = i.dither;
+}
+#endif
+extern "C" uint8_t referenceStateSize() { return StateSize; }
+extern "C" uint8_t referenceGammaChannels() { return SMOOTHLED_GAMMA_CHANNELS; }
+
+extern "C" void referenceUpdate(uint8_t* state, uint16_t count, uint8_t* output,
+    uint8_t dt, uint8_t ditherMask, uint16_t maxValue, const uint16_t* const* gammaLuts, uint16_t dim)
+{
+    for (uint16_t n = 0; n < count; ++n, state += StateSize)
+    {
+        SmoothLed::Interpolator i;
+        loadState(i, state);
+        output[n] = i.update(dt, gammaLuts[n % SMOOTHLED_GAMMA_CHANNELS], maxValue, ditherMask, dim);
+        storeState(i, state);
+    }
+}
+// set up interpolators fading from value to target through the SmoothLed API
+extern "C" void referenceInit(uint8_t* state, uint16_t count, const uint16_t* values,
+    const uint16_t* targets, const uint8_t* dither, const uint16_t* const* gammaLuts, uint8_t gammaLutSize)
+{
+    static SmoothLed::Interpolator interpolators[1024];
+    SmoothLed leds(interpolators, count, SmoothLed::DITHER5, gammaLuts[0], gammaLutSize);
+    leds.setGammaLuts(gammaLuts, gammaLutSize);
+    for (uint16_t n = 0; n < count; ++n)
+    {
+        SmoothLed::Interpolator& i = interpolators[n];
+        i.set(values[n]);
+        if (targets[n] == values[n])
+            leds.clearFadeTarget(n, 1);
+        else
+            i.setFadeTarget(targets[n]);
+        i.dither = dither[n];
+        storeState(i, state + n * StateSize);
+    }
+}
+extern "C" const uint16_t* referenceGamma25() { return SmoothLed::Gamma25; }
+
+// the bulk kernels: per channel Interpolator calls, without the caching
+// SmoothLed adds (the result is whether any step came out 0)
+extern "C" uint8_t referenceSetFadeTargets(uint8_t* state, uint16_t count, const uint8_t* targets,
+    uint8_t range, uint16_t fraction, bool useFraction)
+{
+    uint8_t stopped = 0;
+    for (uint16_t n = 0; n < count; ++n, state += StateSize)
+    {
+        SmoothLed::Interpolator i;
+        loadState(i, state);
+        if (useFraction)
+            i.setFadeTarget(targets[n], range, fraction);
+        else
+            i.setFadeTarget(targets[n], range);
+        stopped |= SMOOTHLED_STATIC_CACHE && i.step == 0;
+        storeState(i, state);
+    }
+    return stopped;
+}
+extern "C" void referenceSet(uint8_t* state, uint16_t count, const uint8_t* values, uint8_t range)
+{
+    for (uint16_t n = 0; n < count; ++n, state += StateSize)
+    {
+        SmoothLed::Interpolator i;
+        loadState(i, state);
+        i.set(values[n], range);
+        storeState(i, state);
+    }
+}
+// APA102 frames of 4 bytes per LED, returns the sum of the channel levels
+extern "C" uint16_t referenceApa102(uint8_t* state, uint16_t leds, uint8_t* output,
+    uint8_t dt, uint8_t ditherMask, uint16_t maxValue, const uint16_t* const* gammaLuts, uint16_t dim)
+{
+    const uint8_t Channels = SmoothLedApa102::ChannelsPerLed;
+    uint16_t sum = 0;
+    for (uint16_t n = 0; n < leds; ++n, state += Channels * StateSize, output += 1 + Channels)
+    {
+        SmoothLed::Interpolator i[Channels];
+        const uint16_t* luts[Channels];
+        for (uint8_t c = 0; c < Channels; ++c)
+        {
+            loadState(i[c], state + c * StateSize);
+            luts[c] = gammaLuts[(n * Channels + c) % SMOOTHLED_GAMMA_CHANNELS];
+        }
+        sum += SmoothLedApa102::updateLed(i, output, dt, luts, maxValue, ditherMask, dim);
+        for (uint8_t c = 0; c < Channels; ++c)
+            storeState(i[c], state + c * StateSize);
+    }
+    return sum;
+}
+'''
+
+
+def build_library(defines, source):
+    """Build source with the library's C++ for the host and load it."""
+    build = tempfile.mkdtemp(prefix='smoothled')
+    shim = os.path.join(build, 'reference.cpp')
+    with open(shim, 'w') as f:
+        f.write(source)
+    library = os.path.join(build, 'reference.so')
+    sources = sorted(glob.glob(os.path.join(SRC, '*.cpp')))
+    args = ['g++', '-std=c++11', '-O1', '-shared', '-fPIC', '-DSMOOTHLED_ASM_UPDATE=0',
+            '-I', os.path.join(HERE, 'host'), '-I', SRC, shim] + sources + ['-o', library]
+    args[1:1] = ['-D%s=%s' % d for d in defines.items()]
+    subprocess.check_call(args)
+    return ctypes.CDLL(library)
+
+
+def build_reference(defines):
+    reference = build_library(defines, REFERENCE_SHIM)
+    reference.referenceGamma25.restype = ctypes.c_void_p
+    reference.referenceSetFadeTargets.restype = ctypes.c_uint8
+    reference.referenceApa102.restype = ctypes.c_uint16
+    reference.stateSize = reference.referenceStateSize()
+    reference.gammaChannels = reference.referenceGammaChannels()
+    return reference
+
+
+def gamma_table(gamma, maxbright, size):
+    # same formula as makeGammaTable.py
+    maxvalue = (size - 1) * 256
+    return [(0xff00 - int(math.pow(i * maxbright / (size - 1) * maxvalue / (maxvalue - 1), gamma) * 0xff00 + .5)) & 0xffff
+            for i in range(size)]
+
+
+def random_gamma(rng, reference, size):
+    """One random table for each of the reference's gamma channels."""
+    gamma = rng.uniform(1.0, 3.0)
+    return [gamma_table(gamma, rng.uniform(0.2, 1.0), size) for _ in range(reference.gammaChannels)]
+
+
+def lut_pointers(tables):
+    """ctypes array of pointers to the tables, plus the arrays it points to."""
+    arrays = [(ctypes.c_uint16 * len(t))(*t) for t in tables]
+    pointers = (ctypes.POINTER(ctypes.c_uint16) * len(arrays))(
+        *[ctypes.cast(a, ctypes.POINTER(ctypes.c_uint16)) for a in arrays])
+    pointers.keep = arrays
+    return pointers
+
+
+def pack_words(words):
+    return b''.join(bytes((w & 0xff, (w >> 8) & 0xff)) for w in words)
+
+
+def random_state(reference, rng, count, gamma, static_fraction=0.0, max_value=None):
+    if max_value is None:
+        max_value = (len(gamma[0]) - 1) * 256 - 1
+    values = [rng.randint(0, max_value) for _ in range(count)]
+    targets = [v if rng.random() < static_fraction else rng.randint(0, max_value) for v in values]
+    dither = [rng.randint(0, 255) for _ in range(count)]
+    state = bytearray(count * reference.stateSize)
+    reference.referenceInit((ctypes.c_uint8 * len(state)).from_buffer(state), count,
+        (ctypes.c_uint16 * count)(*values), (ctypes.c_uint16 * count)(*targets),
+        (ctypes.c_uint8 * count)(*dither), lut_pointers(gamma), len(gamma[0]))
+    return state
+
+
+class Kernels:
+    def __init__(self, defines, state_size, gamma_channels):
+        self.state_size = state_size
+        self.gamma_channels = gamma_channels
+        # SMOOTHLED_POWER_SUM: the kernels return the sum of the bytes they
+        # sent, called in chunks like SmoothLed::update and SmoothLedMulti
+        self.power_sum = int(defines.get('SMOOTHLED_POWER_SUM', 0))
+        self.sum = None
+        # SMOOTHLED_IDLE_DETECT: bit 0 of the result is set when any channel
+        # changed its dither state
+        self.idle_detect = int(defines.get('SMOOTHLED_IDLE_DETECT', 0))
+        # SMOOTHLED_COMPACT_INTERPOLATOR: steps are in units of 1 << this
+        self.step_shift = int(defines.get('SMOOTHLED_COMPACT_STEP_SHIFT', 6))
+        self.dithering = None
+        self.machine = avrSimulator.load(os.path.join(SRC, 'SmoothLedUpdate.S'),
+            dict(defines, SmoothLedApa102Scale='0x%04x' % APA102_SCALE_ADDRESS))
+        self.usart = avrSimulator.TxPeripheral(
+            avrSimulator.IO_REGISTERS['USART0_TXDATAL'], avrSimulator.IO_REGISTERS['USART0_STATUS'], 64)
+        self.machine.attach(self.usart)
+        self.spi = avrSimulator.TxPeripheral(
+            avrSimulator.IO_REGISTERS['SPI0_DATA'], avrSimulator.IO_REGISTERS['SPI0_INTFLAGS'], 64)
+        self.machine.attach(self.spi)
+
+    def setup(self, state, gamma, state_address=INTERPOLATOR_ADDRESS, gamma_address=GAMMA_ADDRESS):
+        m = self.machine
+        m.write_bytes(state_address, state)
+        for k, table in enumerate(gamma):
+            m.write_bytes(gamma_address + k * 0x100, pack_words(table))
+
+    def table_addresses(self, gamma_address, index):
+        """Addresses of the tables from channel index on, in channel order."""
+        n = self.gamma_channels
+        return [gamma_address + ((index + k) % n) * 0x100 for k in range(n)]
+
+    def gamma_argument(self, gamma_address, index=0, list_address=GAMMA_LIST_ADDRESS):
+        """gammaLut argument of the single strip kernels (see SmoothLed::getKernelGammaLuts)."""
+        if self.gamma_channels == 1:
+            return gamma_address
+        self.machine.write_bytes(list_address, pack_words(self.table_addresses(gamma_address, index)))
+        return list_address
+
+    def chunks(self, count, pairs=False):
+        """(offset, length) of the kernel calls for count channels."""
+        if not self.power_sum:
+            return [(0, count)] if count else []
+        size = (128 if pairs else 256) // self.gamma_channels * self.gamma_channels
+        return [(offset, min(size, count - offset)) for offset in range(0, count, size)]
+
+    def add_result(self):
+        if self.power_sum:
+            self.sum += self.machine.pair(24)
+        if self.idle_detect:
+            self.dithering |= bool(self.machine.r[22] & 1)
+
+    def update(self, count, dt, dither_mask, max_value, dim=0):
+        m = self.machine
+        cycles = 0
+        self.sum = 0
+        self.dithering = False
+        for offset, n in self.chunks(count):
+            cycles = m.call('SmoothLedUpdate', [(n, 2), (INTERPOLATOR_ADDRESS + offset * self.state_size, 2),
+                (OUTPUT_ADDRESS + offset, 2), (dt, 1), (dither_mask, 2), (max_value, 2),
+                (self.gamma_argument(GAMMA_ADDRESS, offset), 2), (dim, 2)], start_cycle=cycles)
+            self.add_result()
+        return m.read_bytes(OUTPUT_ADDRESS, count), cycles
+
+    def update8cpb(self, count, dt, dither_mask, max_value, bit_cycles, dim=0):
+        m = self.machine
+        self.usart.reset()
+        self.usart.cycles_per_byte = bit_cycles * 8
+        cycles = 0
+        self.sum = 0
+        self.dithering = False
+        for offset, n in self.chunks(count):
+            cycles = m.call('SmoothLedUpdate8cpb', [(n, 2), (INTERPOLATOR_ADDRESS + offset * self.state_size, 2),
+                (self.usart.data_address, 2), (dt, 1), (dither_mask, 2), (max_value, 2),
+                (self.gamma_argument(GAMMA_ADDRESS, offset), 2), (self.usart.status_address, 2), (dim, 2)],
+                start_cycle=cycles)
+            self.add_result()
+        if self.usart.overruns:
+            raise avrSimulator.SimulatorError('data register overrun')
+        finished = self.usart.finish()
+        return self.usart.values(), cycles, finished
+
+    def update_targets8cpb(self, count, targets, dt, dither_mask, max_value, fraction, bit_cycles, dim=0):
+        """SmoothLedUpdateTargets8cpb in chunks like SmoothLed::updateAndSetFadeTarget."""
+        m = self.machine
+        self.usart.reset()
+        self.usart.cycles_per_byte = bit_cycles * 8
+        m.write_bytes(OUTPUT_ADDRESS, targets)
+        cycles = 0
+        self.sum = 0
+        self.dithering = False
+        for offset in range(0, count, TARGETS_CHUNK):
+            n = min(TARGETS_CHUNK, count - offset)
+            cycles = m.call('SmoothLedUpdateTargets8cpb', [(n, 2),
+                (INTERPOLATOR_ADDRESS + offset * self.state_size, 2), (OUTPUT_ADDRESS + offset, 2),
+                (dt, 1), (dither_mask, 2), (max_value, 2), (self.gamma_argument(GAMMA_ADDRESS, offset), 2),
+                (fraction, 2), (dim, 2)], start_cycle=cycles)
+            if self.power_sum:
+                self.sum += m.pair(24)
+            self.dithering |= bool(m.r[22] & 1)
+        if self.usart.overruns:
+            raise avrSimulator.SimulatorError('data register overrun')
+        finished = self.usart.finish()
+        return self.usart.values(), cycles, finished
+
+    def update_dual(self, strips, bit_cycles):
+        """Same sequence as SmoothLedMulti::update.
+
+        strips is [(count, dt, dither_mask, max_value, dim)] for the SPI strip
+        (state at INTERPOLATOR_ADDRESS) and the USART strip (state at
+        INTERPOLATOR_B_ADDRESS).
+        """
+        m = self.machine
+        addresses = [(INTERPOLATOR_ADDRESS, GAMMA_ADDRESS), (INTERPOLATOR_B_ADDRESS, GAMMA_B_ADDRESS)]
+        params = b''
+        for (count, dt, mask, max_value, dim), (state, gamma) in zip(strips, addresses):
+            params += pack_words([state, gamma, max_value]) + bytes((dt, mask)) + pack_words([dim])
+        if self.gamma_channels > 1:
+            # {spi, usart} pairs for each channel, then a null pair
+            pairs = zip(*[self.table_addresses(gamma, 0) for _, gamma in addresses])
+            params += pack_words([a for pair in pairs for a in pair] + [0, 0])
+        for p in (self.spi, self.usart):
+            p.reset()
+            p.cycles_per_byte = bit_cycles * 8
+        common = min(strips[0][0], strips[1][0])
+        cycles = 0
+        self.sum = 0
+        self.dithering = False
+        for offset, n in self.chunks(common, pairs=True):
+            # the interpolator pointers are at the start of each strip's params
+            for k, (state, _) in enumerate(addresses):
+                params = params[:k * 10] + pack_words([state + offset * self.state_size]) + params[k * 10 + 2:]
+            m.write_bytes(PARAMS_ADDRESS, params)
+            cycles = m.call('SmoothLedUpdateDual', [(n, 2), (PARAMS_ADDRESS, 2)], start_cycle=cycles)
+            self.add_result()
+        for (count, dt, mask, max_value, dim), (state, gamma), p in zip(strips, addresses, (self.spi, self.usart)):
+            for offset, n in self.chunks(count - common):
+                offset += common
+                cycles = m.call('SmoothLedUpdate8cpb', [(n, 2),
+                    (state + offset * self.state_size, 2), (p.data_address, 2), (dt, 1), (mask, 2),
+                    (max_value, 2), (self.gamma_argument(gamma, offset), 2), (p.status_address, 2), (dim, 2)],
+                    start_cycle=cycles)
+                self.add_result()
+        if self.spi.overruns or self.usart.overruns:
+            raise avrSimulator.SimulatorError('data register overrun')
+        finished = max(self.spi.finish(), self.usart.finish())
+        return self.spi.values(), self.usart.values(), cycles, finished
+
+    def update_apa102(self, leds, dt, dither_mask, max_value, dim=0):
+        """Same sequence as SmoothLedApa102::update, without the start and end frames."""
+        m = self.machine
+        self.spi.reset()
+        self.spi.cycles_per_byte = APA102_BYTE_CYCLES
+        chunk = 84 if self.power_sum else 252
+        cycles = 0
+        self.sum = 0
+        self.dithering = False
+        for offset in range(0, leds, chunk):
+            n = min(chunk, leds - offset)
+            cycles = m.call('SmoothLedUpdateApa102', [(n, 2),
+                (INTERPOLATOR_ADDRESS + offset * 3 * self.state_size, 2), (dt, 1), (dither_mask, 2),
+                (max_value, 2), (self.gamma_argument(GAMMA_ADDRESS, offset * 3), 2), (dim, 2)],
+                start_cycle=cycles)
+            self.add_result()
+        if self.spi.overruns:
+            raise avrSimulator.SimulatorError('data register overrun')
+        finished = self.spi.finish()
+        return self.spi.values(), cycles, finished
+
+    def set_fade_targets(self, count, targets, range_, fraction, index=0):
+        """SmoothLedSetFadeTargets on the interpolators from index, returns (result, cycles)."""
+        m = self.machine
+        m.write_bytes(OUTPUT_ADDRESS, targets)
+        cycles = m.call('SmoothLedSetFadeTargets', [(count, 2), (INTERPOLATOR_ADDRESS + index * self.state_size, 2),
+            (OUTPUT_ADDRESS, 2), (range_, 1), (fraction, 2)])
+        return m.r[24], cycles
+
+    def set_values(self, count, values, range_):
+        m = self.machine
+        m.write_bytes(OUTPUT_ADDRESS, values)
+        return m.call('SmoothLedSet', [(count, 2), (INTERPOLATOR_ADDRESS, 2), (OUTPUT_ADDRESS, 2), (range_, 1)])
+
+    def state(self, count, state_address=INTERPOLATOR_ADDRESS):
+        return self.machine.read_bytes(state_address, count * self.state_size)
+
+    def dither_changed(self, before, after):
+        """Whether any channel's dither byte (the last of its state) differs."""
+        size = self.state_size
+        return before[size - 1::size] != after[size - 1::size]
+
+
+def verify(kernels, reference, args, rng):
+    gamma25 = ctypes.cast(reference.referenceGamma25(), ctypes.POINTER(ctypes.c_uint16))
+    failures = 0
+    for trial in range(args.trials):
+        if trial == 0:
+            size = 32
+            gamma = [[gamma25[i] for i in range(size)]] * reference.gammaChannels
+        else:
+            size = rng.choice([16, 24, 32, 64, 128])
+            gamma = random_gamma(rng, reference, size)
+        max_value = (size - 1) * 256 - 1
+        count = rng.randint(1, args.channels)
+        mask = rng.choice(DITHER_MASKS)
+        state = random_state(reference, rng, count, gamma, rng.random())
+        expected = bytearray(state)
+        kernels.setup(state, gamma)
+        lut = lut_pointers(gamma)
+        dim = rng.choice([0, 0xffff, rng.randint(0, 0xffff)])
+        for frame in range(args.frames):
+            dt = rng.choice([0, 1, 2, rng.randint(0, 16), rng.randint(0, 128), rng.randint(0, 255)])
+            before = bytes(expected)
+            buf = (ctypes.c_uint8 * len(expected)).from_buffer(expected)
+            out = (ctypes.c_uint8 * count)()
+            reference.referenceUpdate(buf, count, out, dt, mask, max_value, lut, dim)
+            if trial & 1:
+                actual, _ = kernels.update(count, dt, mask, max_value, dim)
+                name = 'SmoothLedUpdate'
+            else:
+                actual, _, _ = kernels.update8cpb(count, dt, mask, max_value, args.bit_cycles, dim)
+                name = 'SmoothLedUpdate8cpb'
+            if kernels.power_sum and kernels.sum != sum(out):
+                failures += 1
+                print('MISMATCH %s trial %i frame %i: sum %i expected %i' % (name, trial, frame, kernels.sum, sum(out)))
+            if kernels.idle_detect and kernels.dithering != kernels.dither_changed(before, expected):
+                failures += 1
+                print('MISMATCH %s trial %i frame %i: dithering %i' % (name, trial, frame, kernels.dithering))
+            if actual != bytes(out) or kernels.state(count) != bytes(expected):
+                failures += 1
+                print('MISMATCH %s trial %i frame %i: count=%i dt=%i mask=0x%02x lutsize=%i dim=0x%04x'
+                      % (name, trial, frame, count, dt, mask, size, dim))
+                state_size = kernels.state_size
+                for n in range(count):
+                    s = kernels.state(count)[n * state_size:(n + 1) * state_size]
+                    e = bytes(expected[n * state_size:(n + 1) * state_size])
+                    if actual[n] != out[n] or s != e:
+                        print('  channel %i: output %02x expected %02x, state %s expected %s'
+                              % (n, actual[n], out[n], s.hex(), e.hex()))
+                        break
+                kernels.setup(expected, gamma)
+    return failures
+
+
+def verify_dual(kernels, reference, args, rng):
+    failures = 0
+    for trial in range(args.trials):
+        strips = []
+        for state_address, gamma_address in ((INTERPOLATOR_ADDRESS, GAMMA_ADDRESS),
+                                             (INTERPOLATOR_B_ADDRESS, GAMMA_B_ADDRESS)):
+            size = rng.choice([16, 32, 64])
+            gamma = random_gamma(rng, reference, size)
+            count = rng.randint(1, args.channels)
+            state = random_state(reference, rng, count, gamma, rng.random())
+            kernels.setup(state, gamma, state_address, gamma_address)
+            strips.append(dict(count=count, mask=rng.choice(DITHER_MASKS), max_value=(size - 1) * 256 - 1,
+                               lut=lut_pointers(gamma), expected=bytearray(state),
+                               dim=rng.choice([0, rng.randint(0, 0xffff)]),
+                               address=state_address))
+        for frame in range(args.frames):
+            outputs = []
+            dithering = False
+            for s in strips:
+                before = bytes(s['expected'])
+                s['dt'] = rng.choice([0, 1, rng.randint(0, 16), rng.randint(0, 255)])
+                buf = (ctypes.c_uint8 * len(s['expected'])).from_buffer(s['expected'])
+                out = (ctypes.c_uint8 * s['count'])()
+                reference.referenceUpdate(buf, s['count'], out, s['dt'], s['mask'], s['max_value'], s['lut'], s['dim'])
+                outputs.append(bytes(out))
+                dithering |= kernels.dither_changed(before, s['expected'])
+            spi, usart, _, _ = kernels.update_dual(
+                [(s['count'], s['dt'], s['mask'], s['max_value'], s['dim']) for s in strips], args.bit_cycles)
+            if kernels.power_sum and kernels.sum != sum(outputs[0]) + sum(outputs[1]):
+                failures += 1
+                print('MISMATCH SmoothLedUpdateDual trial %i frame %i: sum %i expected %i'
+                      % (trial, frame, kernels.sum, sum(outputs[0]) + sum(outputs[1])))
+            if kernels.idle_detect and kernels.dithering != dithering:
+                failures += 1
+                print('MISMATCH SmoothLedUpdateDual trial %i frame %i: dithering %i' % (trial, frame, kernels.dithering))
+            for name, actual, expected, s in zip(('SPI', 'USART'), (spi, usart), outputs, strips):
+                if actual != expected or kernels.state(s['count'], s['address']) != bytes(s['expected']):
+                    failures += 1
+                    print('MISMATCH SmoothLedUpdateDual %s strip trial %i frame %i: counts=%i,%i'
+                          % (name, trial, frame, strips[0]['count'], strips[1]['count']))
+                    kernels.machine.write_bytes(s['address'], s['expected'])
+    return failures
+
+
+def verify_bulk(kernels, reference, args, rng):
+    """SmoothLedSetFadeTargets and SmoothLedSet against Interpolator::setFadeTarget/set."""
+    failures = 0
+    for trial in range(args.trials):
+        size = rng.choice([16, 32, 64, 128])
+        gamma = random_gamma(rng, reference, size)
+        count = rng.randint(1, args.channels)
+        state = random_state(reference, rng, count, gamma, rng.random())
+        expected = bytearray(state)
+        kernels.setup(state, gamma)
+        buf = (ctypes.c_uint8 * len(expected)).from_buffer(expected)
+        values = [rng.randrange(256) for _ in range(count)]
+        kind = trial % 3
+        if kind == 2:
+            name = 'SmoothLedSet'
+            reference.referenceSet(buf, count, bytes(values), size)
+            kernels.set_values(count, bytes(values), size)
+            result = stopped = 0
+        else:
+            name = 'SmoothLedSetFadeTargets'
+            if trial & 4:
+                # fade from 8 bit levels to the same or a neighbouring one
+                # for steps of 0 and +-1
+                reference.referenceSet(buf, count, bytes(values), size)
+                kernels.setup(expected, gamma)
+                values = [max(0, min(255, v + rng.choice([-1, 0, 0, 1]))) for v in values]
+            use_fraction = kind == 1
+            fraction = rng.choice([0, 1, 0x4000, 0x8000, 0xffff, rng.randint(0, 0xffff)]) if use_fraction else 0x8000
+            stopped = reference.referenceSetFadeTargets(buf, count, bytes(values), size, fraction, use_fraction)
+            result, _ = kernels.set_fade_targets(count, bytes(values), size, fraction)
+        if result != stopped or kernels.state(count) != bytes(expected):
+            failures += 1
+            print('MISMATCH %s trial %i: count=%i lutsize=%i result %i expected %i'
+                  % (name, trial, count, size, result, stopped))
+            state_size = kernels.state_size
+            actual = kernels.state(count)
+            for n in range(count):
+                a = actual[n * state_size:(n + 1) * state_size]
+                e = bytes(expected[n * state_size:(n + 1) * state_size])
+                if a != e:
+                    print('  channel %i: target %02x state %s expected %s' % (n, values[n], a.hex(), e.hex()))
+                    break
+    return failures
+
+
+def verify_convergence(kernels, reference, args, rng):
+    """Fades by a small fraction of the way, a whole fade at a time, reach
+    their targets (to within the step rounding) rather than stalling, and
+    SmoothLedSetFadeTargets keeps matching Interpolator::setFadeTarget."""
+    failures = 0
+    compact = reference.stateSize == 4
+    for trial in range(args.trials):
+        size = rng.choice([16, 32, 64, 128])
+        gamma = random_gamma(rng, reference, size)
+        max_value = (size - 1) * 256 - 1
+        count = rng.randint(1, args.channels)
+        fraction = rng.choice([1, 0x40, 0x100, 0x400, rng.randint(1, 0x1000)])
+        # 8 bit levels a few levels from their targets
+        levels = [rng.randrange(256) for _ in range(count)]
+        targets = bytes(max(0, min(255, v + rng.randint(-3, 3))) for v in levels)
+        state = bytearray(count * reference.stateSize)
+        buf = (ctypes.c_uint8 * len(state)).from_buffer(state)
+        reference.referenceSet(buf, count, bytes(levels), size - 1)
+        kernels.setup(state, gamma)
+        lut = lut_pointers(gamma)
+        out = (ctypes.c_uint8 * count)()
+        offset = 1 if compact else 2
+        values = lambda: [state[n * reference.stateSize + offset] | state[n * reference.stateSize + offset + 1] << 8
+                          for n in range(count)]
+        matched = True
+        # the kernels for the first few fades, then the reference until the
+        # values stop moving
+        for fade in range(4096):
+            before = values()
+            reference.referenceSetFadeTargets(buf, count, targets, size - 1, fraction, True)
+            reference.referenceUpdate(buf, count, out, 128, 0xf8, max_value, lut, 0)
+            if fade < 16:
+                kernels.set_fade_targets(count, targets, size - 1, fraction)
+                kernels.update(count, 128, 0xf8, max_value)
+                if kernels.state(count) != bytes(state):
+                    matched = False
+                    break
+            elif values() == before:
+                break
+        # as compactStep: within half a step unit, otherwise within the
+        # distance fmul takes to 0
+        tolerance = 1 << (kernels.step_shift - 1) if compact else 0x8000 // fraction + 1
+        stalled = [n for n, value in enumerate(values())
+                   if abs(value - (targets[n] * (size - 1) + (targets[n] * (size - 1) >> 8))) > tolerance]
+        if not matched or stalled:
+            failures += 1
+            print('MISMATCH fade convergence trial %i: count=%i lutsize=%i fraction=0x%04x %s'
+                  % (trial, count, size, fraction,
+                     'kernel state differs' if not matched else 'channel %i stalled' % stalled[0]))
+    return failures
+
+
+def verify_targets(kernels, reference, args, rng):
+    """SmoothLedUpdateTargets8cpb against Interpolator::update then setFadeTarget."""
+    failures = 0
+    for trial in range(args.trials):
+        size = rng.choice([16, 32, 64, 128])
+        gamma = random_gamma(rng, reference, size)
+        max_value = (size - 1) * 256 - 1
+        count = rng.randint(1, args.channels)
+        state = random_state(reference, rng, count, gamma, rng.random())
+        expected = bytearray(state)
+        kernels.setup(state, gamma)
+        lut = lut_pointers(gamma)
+        mask = rng.choice(DITHER_MASKS)
+        dim = rng.choice([0, rng.randint(0, 0xffff)])
+        for frame in range(args.frames):
+            dt = rng.choice([0, 1, rng.randint(0, 16), rng.randint(0, 255)])
+            # some targets where the channels already are, for steps of 0
+            targets = bytes(rng.choice([rng.randrange(256), 0, 255]) for _ in range(count))
+            fraction = rng.choice([0x8000, 0x4000, rng.randint(0, 0xffff)])
+            before = bytes(expected)
+            buf = (ctypes.c_uint8 * len(expected)).from_buffer(expected)
+            out = (ctypes.c_uint8 * count)()
+            reference.referenceUpdate(buf, count, out, dt, mask, max_value, lut, dim)
+            flag = kernels.idle_detect and kernels.dither_changed(before, expected)
+            flag |= reference.referenceSetFadeTargets(buf, count, targets, size - 1, fraction, True)
+            actual, _, _ = kernels.update_targets8cpb(count, targets, dt, mask, max_value, fraction,
+                                                      args.bit_cycles, dim)
+            if kernels.power_sum and kernels.sum != sum(out):
+                failures += 1
+                print('MISMATCH SmoothLedUpdateTargets8cpb trial %i frame %i: sum %i expected %i'
+                      % (trial, frame, kernels.sum, sum(out)))
+            if kernels.dithering != bool(flag):
+                failures += 1
+                print('MISMATCH SmoothLedUpdateTargets8cpb trial %i frame %i: flag %i expected %i'
+                      % (trial, frame, kernels.dithering, flag))
+            if actual != bytes(out) or kernels.state(count) != bytes(expected):
+                failures += 1
+                print('MISMATCH SmoothLedUpdateTargets8cpb trial %i frame %i: count=%i dt=%i mask=0x%02x '
+                      'lutsize=%i dim=0x%04x fraction=0x%04x' % (trial, frame, count, dt, mask, size, dim, fraction))
+                state_size = kernels.state_size
+                for n in range(count):
+                    a = kernels.state(count)[n * state_size:(n + 1) * state_size]
+                    e = bytes(expected[n * state_size:(n + 1) * state_size])
+                    if actual[n] != out[n] or a != e:
+                        print('  channel %i: output %02x expected %02x, state %s expected %s'
+                              % (n, actual[n], out[n], a.hex(), e.hex()))
+                        break
+                kernels.setup(expected, gamma)
+    return failures
+
+
+def verify_apa102(kernels, reference, args, rng):
+    """SmoothLedUpdateApa102 against SmoothLedApa102::updateLed."""
+    failures = 0
+    for trial in range(args.trials):
+        size = rng.choice([16, 32, 64, 128])
+        gamma = random_gamma(rng, reference, size)
+        max_value = (size - 1) * 256 - 1
+        # up to 2/3 as many LEDs as channels, more than one kernel call with
+        # SMOOTHLED_POWER_SUM (it doesn't use the output buffer)
+        leds = rng.randint(1, max(1, args.channels * 2 // 3))
+        count = leds * 3
+        # dim strips too, so that every global current is used
+        state = random_state(reference, rng, count, gamma, rng.random(),
+                             rng.choice([max_value, rng.randint(0, max_value), rng.randint(0, max_value // 8)]))
+        expected = bytearray(state)
+        kernels.setup(state, gamma)
+        lut = lut_pointers(gamma)
+        mask = rng.choice(DITHER_MASKS)
+        dim = rng.choice([0, 0xffff, rng.randint(0, 0xffff)])
+        for frame in range(args.frames):
+            dt = rng.choice([0, 1, rng.randint(0, 16), rng.randint(0, 255)])
+            before = bytes(expected)
+            buf = (ctypes.c_uint8 * len(expected)).from_buffer(expected)
+            out = (ctypes.c_uint8 * (leds * 4))()
+            levels = reference.referenceApa102(buf, leds, out, dt, mask, max_value, lut, dim)
+            actual, _, _ = kernels.update_apa102(leds, dt, mask, max_value, dim)
+            if kernels.power_sum and kernels.sum != levels:
+                failures += 1
+                print('MISMATCH SmoothLedUpdateApa102 trial %i frame %i: sum %i expected %i'
+                      % (trial, frame, kernels.sum, levels))
+            if kernels.idle_detect and kernels.dithering != kernels.dither_changed(before, expected):
+                failures += 1
+                print('MISMATCH SmoothLedUpdateApa102 trial %i frame %i: dithering %i'
+                      % (trial, frame, kernels.dithering))
+            if actual != bytes(out) or kernels.state(count) != bytes(expected):
+                failures += 1
+                print('MISMATCH SmoothLedUpdateApa102 trial %i frame %i: leds=%i dt=%i mask=0x%02x lutsize=%i dim=0x%04x'
+                      % (trial, frame, leds, dt, mask, size, dim))
+                for n in range(leds):
+                    if actual[n * 4:n * 4 + 4] != bytes(out[n * 4:n * 4 + 4]):
+                        print('  led %i: frame %s expected %s' % (n, actual[n * 4:n * 4 + 4].hex(),
+                                                                  bytes(out[n * 4:n * 4 + 4]).hex()))
+                        break
+                kernels.setup(expected, gamma)
+    return failures
+
+
+def benchmark(kernels, reference, args, rng):
+    size = 32
+    gamma = [gamma_table(2.5, 1.0, size)] * reference.gammaChannels
+    max_value = (size - 1) * 256 - 1
+    count = args.channels
+    scenarios = [
+        ('not fading (dt=0)', 0.0, 0),
+        ('static channels', 1.0, 16),
+        ('90% static channels', 0.9, 16),
+        ('all fading', 0.0, 16),
+    ]
+    print('%-30s %14s %14s %14s %14s' % ('scenario', 'buffered c/B', 'buffered c/f',
+                                          '8cpb c/B', '8cpb frame'))
+    for name, static_fraction, dt in scenarios:
+        state = random_state(reference, rng, count, gamma, static_fraction)
+        kernels.setup(state, gamma)
+        _, buffered = kernels.update(count, dt, 0xf8, max_value)
+        kernels.setup(state, gamma)
+        _, cycles, finished = kernels.update8cpb(count, dt, 0xf8, max_value, args.bit_cycles)
+        print('%-30s %14.1f %14i %14.1f %14i' % (name, buffered / count, buffered,
+                                                   cycles / count, finished))
+    print('8cpb transmit time for %i bytes at %i cycles per bit: %i cycles'
+          % (count, args.bit_cycles, count * 8 * args.bit_cycles))
+
+    # two strips of the same length, all channels fading
+    print()
+    print('%-30s %14s %14s %14s' % ('two strips of %i bytes' % count, 'sequential', 'dual', 'dual c/B pair'))
+    state = random_state(reference, rng, count, gamma, 0.0)
+    for bit_cycles in (args.bit_cycles, args.bit_cycles * 2):
+        kernels.setup(state, gamma)
+        _, _, first = kernels.update8cpb(count, 16, 0xf8, max_value, bit_cycles)
+        kernels.setup(state, gamma)
+        kernels.setup(state, gamma, INTERPOLATOR_B_ADDRESS, GAMMA_B_ADDRESS)
+        _, _, cycles, dual = kernels.update_dual([(count, 16, 0xf8, max_value, 0)] * 2, bit_cycles)
+        print('%-30s %14i %14i %14.1f' % ('%i cycles per bit' % bit_cycles, 2 * first, dual, cycles / count))
+
+    # bulk SmoothLed::setFadeTarget/set of every channel
+    print()
+    print('%-30s %14s %14s' % ('%i channels' % count, 'cycles', 'c/channel'))
+    state = random_state(reference, rng, count, gamma, 0.5)
+    targets = bytes(rng.randrange(256) for _ in range(count))
+    for name, fraction in (('setFadeTarget', 0x8000), ('setFadeTarget (fraction)', 0x5555)):
+        kernels.setup(state, gamma)
+        _, cycles = kernels.set_fade_targets(count, targets, size, fraction)
+        print('%-30s %14i %14.1f' % (name, cycles, cycles / count))
+    kernels.setup(state, gamma)
+    cycles = kernels.set_values(count, targets, size)
+    print('%-30s %14i %14.1f' % ('set', cycles, cycles / count))
+    # the same channels through the bulk kernel a few at a time, one channel
+    # or one LED (as SmoothLedPixels passes them) per call, kernel cycles
+    # only.  The per channel setFadeTarget(index, target) is C++ and isn't
+    # simulated.
+    for per_call in (1, 3, 4):
+        kernels.setup(state, gamma)
+        channels = count - count % per_call
+        cycles = 0
+        for n in range(0, channels, per_call):
+            _, call_cycles = kernels.set_fade_targets(per_call, targets[n:n + per_call], size, 0x5555, n)
+            cycles += call_cycles
+        print('%-30s %14i %14.1f' % ('bulk kernel, %i per call' % per_call, cycles, cycles / channels))
+
+    # update then setFadeTarget of every channel over USART, at the byte
+    # rate begin's default 600ns high pulse gives at each F_CPU (see
+    # SMOOTHLED_BYTE_CYCLES), one after the other and fused.  The CPU is
+    # free for the rest of the frame while waiting for the USART.
+    print()
+    print('%-10s %6s %10s %16s %22s %16s' % ('update %i' % count, 'c/B', 'transmit',
+                                            '8cpb (free)', '+ setFadeTarget (free)', 'fused (free)'))
+    state = random_state(reference, rng, count, gamma, 0.0)
+    for mhz in (8, 10, 16, 20):
+        bit_cycles = 2 * max((600 * mhz + 500) // 1000, 4)
+        kernels.setup(state, gamma)
+        _, busy, _ = kernels.update8cpb(count, 16, 0xf8, max_value, 1)
+        kernels.setup(state, gamma)
+        _, cycles, frame = kernels.update8cpb(count, 16, 0xf8, max_value, bit_cycles)
+        _, targets_cycles = kernels.set_fade_targets(count, targets, size - 1, 0x5555)
+        sequential = max(frame, cycles + targets_cycles)
+        kernels.setup(state, gamma)
+        _, fused_busy, _ = kernels.update_targets8cpb(count, targets, 16, 0xf8, max_value, 0x5555, 1)
+        kernels.setup(state, gamma)
+        _, _, fused = kernels.update_targets8cpb(count, targets, 16, 0xf8, max_value, 0x5555, bit_cycles)
+        free = lambda busy, frame: '%i (%2i%%)' % (frame, 100 - 100 * busy // frame)
+        print('%-10s %6i %10i %16s %22s %16s' % ('%iMHz' % mhz, bit_cycles * 8, count * bit_cycles * 8,
+              free(busy, frame), free(busy + targets_cycles, sequential), free(fused_busy, fused)))
+
+    # setMapping: a strip mirrored about the middle, count outputs from
+    # count / 2 interpolators.  The logical frame is calculated into the
+    # buffer by the buffered kernel before the first byte goes out, then
+    # streamed run by run from C++ (not simulated, its loop is assumed to
+    # keep up with the USART), against the unmapped strip's update8cpb.
+    print()
+    print('%-10s %10s %16s %16s' % ('mapped %i' % count, 'transmit', 'unmapped', 'mirrored'))
+    logical = count // 2
+    for mhz in (8, 10, 16, 20):
+        bit_cycles = 2 * max((600 * mhz + 500) // 1000, 4)
+        transmit = count * bit_cycles * 8
+        kernels.setup(random_state(reference, rng, count, gamma, 0.0), gamma)
+        _, _, frame = kernels.update8cpb(count, 16, 0xf8, max_value, bit_cycles)
+        kernels.setup(random_state(reference, rng, logical, gamma, 0.0), gamma)
+        _, buffered = kernels.update(logical, 16, 0xf8, max_value)
+        mapped = buffered + transmit
+        print('%-10s %10i %16i %16s' % ('%iMHz' % mhz, transmit, frame,
+              '%i (+%i%%)' % (mapped, 100 * (mapped - frame) // frame)))
+
+    # updateAsync over SPI: the buffered update, then an interrupt for each
+    # byte while the frame goes out, against update8cpb which holds the CPU
+    # for the whole frame (frame cycles and the share of them the CPU is
+    # busy).  SmoothLedCcl picks 8, 16 or 32 cycles per bit
+    # from the high pulse, 32 for the 600ns default at 16MHz.
+    print()
+    print('%-10s %10s %16s %16s' % ('async %i' % count, 'transmit', 'update (busy)', 'async (busy)'))
+    state = random_state(reference, rng, count, gamma, 0.0)
+    for bit_cycles in (8, 16, 32):
+        kernels.setup(state, gamma)
+        _, buffered = kernels.update(count, 16, 0xf8, max_value)
+        kernels.setup(state, gamma)
+        _, _, frame = kernels.update8cpb(count, 16, 0xf8, max_value, bit_cycles)
+        transmit = count * bit_cycles * 8
+        # double buffered, the next frame is calculated while this one is
+        # sent, so a frame takes the longer of the two
+        busy = buffered + count * ASYNC_ISR_CYCLES
+        period = max(transmit, busy)
+        print('%-10s %10i %16s %16s' % ('%i c/bit' % bit_cycles, transmit,
+              '%i (100%%)' % frame, '%i (%3i%%)' % (period, 100 * busy // period)))
+
+    # APA102 frames, SPI at F_CPU / 2
+    print()
+    leds = count // 3
+    print('%-30s %14s %14s' % ('%i APA102 LEDs' % leds, 'c/LED', 'frame'))
+    for name, static_fraction, dt in scenarios:
+        kernels.setup(random_state(reference, rng, leds * 3, gamma, static_fraction), gamma)
+        _, cycles, finished = kernels.update_apa102(leds, dt, 0xf8, max_value)
+        print('%-30s %14.1f %14i' % (name, cycles / leds, finished))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SmoothLed update kernel verification and benchmark')
+    parser.add_argument('--trials', type=int, default=100, help='randomized verification runs (default 100)')
+    parser.add_argument('--frames', type=int, default=8, help='frames per verification run (default 8)')
+    parser.add_argument('--channels', type=int, default=150, help='maximum number of interpolators (default 150)')
+    parser.add_argument('--bit-cycles', type=int, default=8, help='CPU cycles per transmitted bit (default 8)')
+    parser.add_argument('--seed', type=int, default=1, help='random seed')
+    parser.add_argument('-D', dest='defines', action='append', default=[],
+                        help='NAME=VALUE configuration define for both the kernels and the reference')
+    args = parser.parse_args()
+    defines = dict((d.split('=', 1) + ['1'])[:2] for d in args.defines)
+
+    rng = random.Random(args.seed)
+    reference = build_reference(defines)
+    kernels = Kernels(defines, reference.stateSize, reference.gammaChannels)
+    failures = verify(kernels, reference, args, rng)
+    print('%i/%i verification runs matched the C++ reference' % (args.trials - failures, args.trials))
+    dual_failures = verify_dual(kernels, reference, args, rng)
+    print('%i/%i dual strip verification runs matched the C++ reference'
+          % (args.trials - dual_failures, args.trials))
+    failures += dual_failures
+    bulk_failures = verify_bulk(kernels, reference, args, rng)
+    print('%i/%i bulk set/setFadeTarget runs matched the C++ reference'
+          % (args.trials - bulk_failures, args.trials))
+    failures += bulk_failures
+    convergence_failures = verify_convergence(kernels, reference, args, rng)
+    print('%i/%i low fraction fades reached their targets' % (args.trials - convergence_failures, args.trials))
+    failures += convergence_failures
+    targets_failures = verify_targets(kernels, reference, args, rng)
+    print('%i/%i fused update and setFadeTarget runs matched the C++ reference'
+          % (args.trials - targets_failures, args.trials))
+    failures += targets_failures
+    kernels.machine.write_bytes(APA102_SCALE_ADDRESS,
+        pack_words((ctypes.c_uint16 * 32).in_dll(reference, 'SmoothLedApa102Scale')))
+    apa102_failures = verify_apa102(kernels, reference, args, rng)
+    print('%i/%i APA102 runs matched the C++ reference' % (args.trials - apa102_failures, args.trials))
+    failures += apa102_failures
+    benchmark(kernels, reference, args, rng)
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
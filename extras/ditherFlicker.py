@@ -0,0 +1,139 @@
+"""SmoothLed dither flicker metric.
+
+Runs SmoothLed::update (the C++ version built for the host, as in
+benchmarkUpdate.py) on still scenes for every dither mask and dither seed and
+measures what is left for the eye to see at a given refresh rate.  The
+"gradient" scene is a grey ramp along the strip; "flat" sets the whole strip
+to one grey at a time for --steps levels and averages the results, which is
+where neighbouring LEDs line up and the seed matters most.
+
+  flicker  RMS variation, in output levels, of each channel after averaging
+           it over 1 / cutoff seconds worth of frames.  Dithering faster than
+           the cutoff is fused by the eye and doesn't count; a channel that
+           steps up every 32nd frame at 200Hz (6Hz) does.
+  blurred  the same after also averaging each colour over --blur neighbouring
+           LEDs, as seen from a distance or through a diffuser.  This is the
+           part the dither seed changes.
+  error    RMS difference between each channel's average output and its exact
+           gamma corrected value, the stair stepping left by masking off
+           dither bits.
+
+Requires python 3 and a host g++.  Example:
+
+    python3 ditherFlicker.py --rate 200 --channels 300 --scene flat
+"""
+
+import argparse, ctypes, itertools, math, sys
+
+import benchmarkUpdate
+
+DITHER_SHIM = r'''
+#define SMOOTHLED_HOST_PERIPHERALS
+#include "SmoothLed.h"
+
+static SmoothLed::Interpolator interpolators[1024];
+
+extern "C" uint16_t ditherMaxValue() { return (SmoothLed::Gamma25Size - 1) * 256 - 1; }
+
+// frames of output for channels held at values, plus their exact gamma
+// corrected values
+extern "C" void ditherRun(uint16_t count, const uint16_t* values, uint8_t mask, uint8_t seed,
+    uint8_t channelsPerLed, uint16_t frames, uint8_t* output, uint16_t* corrected)
+{
+    SmoothLed leds(interpolators, count, SmoothLed::DitherBits(mask));
+    leds.seedDither(SmoothLed::DitherSeed(seed), channelsPerLed);
+    for (uint16_t n = 0; n < count; ++n)
+    {
+        interpolators[n].set(values[n]);
+        corrected[n] = leds.gammaCorrect(values[n], SmoothLed::getGammaChannel(n));
+    }
+    for (uint16_t f = 0; f < frames; ++f, output += count)
+        leds.update(output);
+}
+'''
+
+MASKS = [('DITHER2', 0xc0), ('DITHER3', 0xe0), ('DITHER4', 0xf0), ('DITHER5', 0xf8),
+         ('DITHER6', 0xfc), ('DITHER7', 0xfe), ('DITHER8', 0xff)]
+SEEDS = ['ramp', 'ordered'] # SmoothLed::DitherSeed order
+
+
+def scenes(max_value, args):
+    """Channel values for each frame of the test scene."""
+    value = lambda level: int(level / 255 * max_value + 0.5)
+    fraction = lambda n, steps: n / max(steps - 1, 1)
+    low, high = args.low, args.high
+    if args.scene == 'flat':
+        return [[value(low + (high - low) * fraction(k, args.steps))] * args.channels
+                for k in range(args.steps)]
+    leds = args.channels // args.channels_per_led
+    return [[value(low + (high - low) * fraction(n // args.channels_per_led, leds))
+             for n in range(args.channels)]]
+
+
+def visible_rms(sequence, window):
+    """Standard deviation of the moving average of window frames."""
+    sums = list(itertools.accumulate(sequence, initial=0))
+    averages = [(b - a) / window for a, b in zip(sums, sums[window:])]
+    mean = sum(averages) / len(averages)
+    return math.sqrt(sum((a - mean) ** 2 for a in averages) / len(averages))
+
+
+def measure(library, values, mask, seed, args):
+    count, frames = len(values), args.frames
+    output = (ctypes.c_uint8 * (count * frames))()
+    corrected = (ctypes.c_uint16 * count)()
+    library.ditherRun(count, (ctypes.c_uint16 * count)(*values), mask, seed,
+                      args.channels_per_led, frames, output, corrected)
+    channels = [output[n::count] for n in range(count)]
+    window = max(1, round(args.rate / args.cutoff))
+    flicker = [visible_rms(c, window) for c in channels]
+    error = [sum(c) / frames - corrected[n] / 256 for n, c in enumerate(channels)]
+    # each colour averaged over blur LEDs
+    stride = args.channels_per_led
+    blurred = []
+    for n in range(count - (args.blur - 1) * stride):
+        neighbours = channels[n:n + args.blur * stride:stride]
+        blurred.append(visible_rms([sum(f) / args.blur for f in zip(*neighbours)], window))
+    return flicker, blurred, error
+
+
+def rms(x):
+    return math.sqrt(sum(v * v for v in x) / len(x)) if x else 0.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SmoothLed dither flicker metric')
+    parser.add_argument('--channels', type=int, default=150, help='number of channels (default 150)')
+    parser.add_argument('--channels-per-led', type=int, default=3, help='3 for RGB, 4 for RGBW (default 3)')
+    parser.add_argument('--rate', type=float, default=200, help='refresh rate in Hz (default 200)')
+    parser.add_argument('--cutoff', type=float, default=50,
+                        help='flicker frequency the eye fuses, in Hz (default 50)')
+    parser.add_argument('--blur', type=int, default=4, help='neighbouring LEDs averaged for "blurred" (default 4)')
+    parser.add_argument('--frames', type=int, default=1024, help='frames simulated (default 1024)')
+    parser.add_argument('--scene', choices=['gradient', 'flat'], default='gradient', help='test scene (default gradient)')
+    parser.add_argument('--low', type=float, default=0.5, help='darkest 8 bit level of the scene (default 0.5)')
+    parser.add_argument('--high', type=float, default=48, help='brightest 8 bit level of the scene (default 48)')
+    parser.add_argument('--steps', type=int, default=16, help='levels of the flat scene (default 16)')
+    parser.add_argument('-D', dest='defines', action='append', default=[],
+                        help='NAME=VALUE configuration define for the library')
+    args = parser.parse_args()
+    defines = dict((d.split('=', 1) + ['1'])[:2] for d in args.defines)
+    if args.channels > 1024:
+        parser.error('at most 1024 channels')
+
+    library = benchmarkUpdate.build_library(defines, DITHER_SHIM)
+    scene = scenes(library.ditherMaxValue(), args)
+    print('%s scene, %g Hz refresh, %g Hz cutoff (%i frame average), %i LED blur, levels %g to %g'
+          % (args.scene, args.rate, args.cutoff, max(1, round(args.rate / args.cutoff)), args.blur,
+             args.low, args.high))
+    print('%-10s %-12s %10s %10s %10s' % ('mask', 'seed', 'flicker', 'blurred', 'error'))
+    for name, mask in MASKS:
+        for seed, seed_name in enumerate(SEEDS):
+            results = [measure(library, values, mask, seed, args) for values in scene]
+            flicker, blurred, error = (rms([v for r in results for v in r[k]]) for k in range(3))
+            print('%-10s %-12s %10.3f %10.3f %10.3f' % (name, seed_name, flicker, blurred, error))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
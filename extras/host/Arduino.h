@@ -0,0 +1,91 @@
+// Minimal stand-in for the megaTinyCore Arduino.h so the library can be
+// compiled on a desktop machine by the scripts in the extras folder.
+// Peripherals are plain memory; nothing here talks to real hardware.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+typedef volatile uint8_t register8_t;
+typedef volatile uint16_t register16_t;
+
+#define _BV(bit) (1 << (bit))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+template<class T, class U> inline auto max(T a, U b) -> decltype(a + b) { return a > b ? a : b; }
+template<class T, class U> inline auto min(T a, U b) -> decltype(a + b) { return a < b ? a : b; }
+
+struct TCB_t { register8_t CTRLA, CTRLB, EVCTRL, INTCTRL, INTFLAGS; register16_t CNT, CCMP; };
+struct SPI_t { register8_t CTRLA, CTRLB, INTCTRL, INTFLAGS, DATA; };
+struct USART_t { register8_t RXDATAL, TXDATAL, STATUS, CTRLA, CTRLB, CTRLC; register16_t BAUD; };
+struct CCL_t { register8_t CTRLA, SEQCTRL0, LUT0CTRLA, LUT0CTRLB, LUT0CTRLC, TRUTH0,
+                           LUT1CTRLA, LUT1CTRLB, LUT1CTRLC, TRUTH1; };
+struct PORTMUX_t { register8_t CTRLA, CTRLB, CTRLC, CTRLD; };
+struct VPORT_t { register8_t DIR, OUT, IN, INTFLAGS; };
+
+extern TCB_t TCB0, TCB1;
+extern SPI_t SPI0;
+extern USART_t USART0;
+extern CCL_t CCL;
+extern PORTMUX_t PORTMUX;
+extern VPORT_t VPORTA, VPORTB, VPORTC;
+extern register8_t EVSYS_ASYNCCH[4];
+extern register8_t EVSYS_ASYNCUSER[13];
+#define EVSYS_ASYNCCH0 EVSYS_ASYNCCH[0]
+#define EVSYS_ASYNCCH1 EVSYS_ASYNCCH[1]
+#define EVSYS_ASYNCCH2 EVSYS_ASYNCCH[2]
+#define EVSYS_ASYNCCH3 EVSYS_ASYNCCH[3]
+#define EVSYS_ASYNCUSER0 EVSYS_ASYNCUSER[0]
+#define EVSYS_ASYNCUSER8 EVSYS_ASYNCUSER[8]
+#define EVSYS_ASYNCUSER11 EVSYS_ASYNCUSER[11]
+#define TCB1 TCB1
+#define VPORTC VPORTC
+
+// SmoothLed::updateChunk's clock, moved on by the host scripts
+extern unsigned long hostMicros;
+inline unsigned long micros() { return hostMicros; }
+
+// define SMOOTHLED_HOST_PERIPHERALS in exactly one translation unit
+#ifdef SMOOTHLED_HOST_PERIPHERALS
+unsigned long hostMicros;
+TCB_t TCB0, TCB1;
+SPI_t SPI0;
+USART_t USART0;
+CCL_t CCL;
+PORTMUX_t PORTMUX;
+VPORT_t VPORTA, VPORTB, VPORTC;
+register8_t EVSYS_ASYNCCH[4];
+register8_t EVSYS_ASYNCUSER[13];
+#endif
+
+enum {
+    TCB_CAPTEI_bm = 0x01, TCB_CNTMODE_SINGLE_gc = 0x06, TCB_ASYNC_bm = 0x40,
+    TCB_CLKSEL_CLKDIV1_gc = 0x00, TCB_ENABLE_bm = 0x01,
+
+    SPI_ENABLE_bm = 0x01, SPI_PRESC_DIV4_gc = 0x00, SPI_PRESC_DIV16_gc = 0x02, SPI_PRESC_DIV64_gc = 0x04,
+    SPI_PRESC_DIV128_gc = 0x06, SPI_PRESC_gm = 0x06,
+    SPI_CLK2X_bm = 0x10, SPI_MASTER_bm = 0x20, SPI_SSD_bm = 0x04, SPI_MODE_0_gc = 0x00,
+    SPI_BUFEN_bm = 0x80, SPI_DREIF_bm = 0x20, SPI_DREIF_bp = 5, SPI_TXCIF_bm = 0x40,
+    SPI_DREIE_bm = 0x20, SPI_TXCIE_bm = 0x40,
+
+    USART_DREIF_bm = 0x20, USART_DREIF_bp = 5, USART_TXCIF_bm = 0x40, USART_TXEN_bm = 0x40,
+    USART_CMODE_MSPI_gc = 0xC0, USART_UCPHA_bm = 0x02, USART_DREIE_bm = 0x20, USART_TXCIE_bm = 0x40,
+
+    CCL_ENABLE_bm = 0x01, CCL_OUTEN_bm = 0x40,
+    CCL_INSEL2_TCB0_gc = 0x0C, CCL_INSEL1_SPI0_gc = 0x90, CCL_INSEL0_SPI0_gc = 0x09,
+    CCL_INSEL1_USART0_gc = 0x80, CCL_INSEL0_USART0_gc = 0x08,
+
+    PORTMUX_USART0_ALTERNATE_gc = 0x01, PORTMUX_SPI0_ALTERNATE_gc = 0x04,
+    PORTMUX_LUT0_bm = 0x10, PORTMUX_LUT1_bm = 0x20, PORTMUX_EVOUT0_bm = 0x01,
+
+    EVSYS_ASYNCCH0_PORTA_PIN3_gc = 0x0D, EVSYS_ASYNCCH1_PORTB_PIN1_gc = 0x0B,
+    EVSYS_ASYNCCH2_PORTC_PIN0_gc = 0x0A, EVSYS_ASYNCCH0_CCL_LUT0_gc = 0x03,
+    EVSYS_ASYNCUSER0_ASYNCCH0_gc = 0x03, EVSYS_ASYNCUSER0_ASYNCCH1_gc = 0x04,
+    EVSYS_ASYNCUSER0_ASYNCCH2_gc = 0x05, EVSYS_ASYNCUSER8_ASYNCCH0_gc = 0x03,
+};
@@ -1,6 +1,6 @@
 import math, argparse
 
-def printGammaTable(gamma = 2.5, maxbright = 1.0, tablesize = 32):
+def printGammaTable(gamma = 2.5, maxbright = 1.0, tablesize = 32, suffix = ''):
     maxvalue = (tablesize - 1) * 256
     e = []
     for i in range(tablesize):
@@ -9,6 +9,7 @@ def printGammaTable(gamma = 2.5, maxbright = 1.0, tablesize = 32):
     name = 'Gamma%i_%i' % (int(gamma), int(gamma * 10) % 10)
     if maxbright != 1.0:
         name += '_Brightness%i' % int(maxbright * 100)
+    name += suffix
     print('const uint16_t %s[%i] =' % (name, tablesize))
     print('{')
     s = '    '
@@ -26,8 +27,13 @@ def main():
     parser.add_argument('-g', '--gamma', help='Gamma correction value (default 2.5)', type=float, default = 2.5)
     parser.add_argument('-b', '--maxbright', help='Maximum brightness value (0-1)', type=float, default = 1.0)
     parser.add_argument('-s', '--tablesize', help='Number of table entries (16-128)', type=int, default = 32)
+    parser.add_argument('-w', '--balance', help='Comma separated brightness scale for each channel, e.g. 0.8,1,0.9 (one table per channel)')
     args = parser.parse_args()
-    printGammaTable(args.gamma, args.maxbright, args.tablesize)
+    if args.balance:
+        for channel, scale in enumerate(args.balance.split(',')):
+            printGammaTable(args.gamma, args.maxbright * float(scale), args.tablesize, '_Channel%i' % channel)
+    else:
+        printGammaTable(args.gamma, args.maxbright, args.tablesize)
 
 if __name__ == '__main__':
     main()
\ No newline at end of file
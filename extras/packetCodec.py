@@ -0,0 +1,199 @@
+"""SmoothLedReceiver compressed packet payloads.
+
+encode() makes the payload SmoothLedReceiver::receiveCompressed (and
+SmoothLedBuffer::decode) takes: a byte with how many frames back the frame it
+is relative to was (0 for none), then runs of
+
+    0x00-0x7f  code + 1 deltas follow, one for each byte
+    0x80-0xbf  code - 0x7f bytes unchanged
+    0xc0-0xff  code - 0xbf bytes all change by the delta that follows
+
+Deltas are added modulo 256.  A still frame of any size is a few bytes and a
+fade that moves every channel by the same step is two bytes per 64 channels.
+The receiver drops a packet whose base frame it doesn't hold (lost, or more
+than NumBufferedFrames - 1 frames back), so send a packet relative to nothing
+(back = 0) every so often, and send it raw when that is no bigger (a payload
+is at most 255 bytes).
+
+Run as a script it round trips random frame sequences through the C++ decoder
+built for the host (see benchmarkUpdate.py) and reports the compression:
+
+    python3 packetCodec.py --trials 200
+"""
+
+import argparse, ctypes, random, sys
+
+import benchmarkUpdate
+
+MAX_LITERALS = 0x80
+MAX_RUN = 0x40
+
+
+def encode(frame, base=None, back=1):
+    """Payload for frame relative to base, the frame back frames earlier."""
+    if base is None:
+        base, back = bytes(len(frame)), 0
+    deltas = [(f - b) & 0xff for f, b in zip(frame, base)]
+    out = bytearray([back])
+    literals = []
+
+    def flush():
+        if literals:
+            out.append(len(literals) - 1)
+            out.extend(literals)
+            del literals[:]
+
+    i = 0
+    while i < len(deltas):
+        d = deltas[i]
+        run = 1
+        while i + run < len(deltas) and run < MAX_RUN and deltas[i + run] == d:
+            run += 1
+        # a single unchanged byte costs the same inside a literal run, and a
+        # repeat needs 3 to beat 3 literals
+        if (d == 0 and (run >= 2 or not literals)) or run >= 3:
+            flush()
+            if d == 0:
+                out.append(0x80 + run - 1)
+            else:
+                out.extend((0xc0 + run - 1, d))
+            i += run
+        else:
+            literals.append(d)
+            if len(literals) == MAX_LITERALS:
+                flush()
+            i += 1
+    flush()
+    return bytes(out)
+
+
+def decode(payload, base, size):
+    """Python version of SmoothLedBuffer::decode, None if it doesn't add up."""
+    if not payload:
+        return None
+    if payload[0] == 0:
+        base = bytes(size)
+    elif base is None:
+        return None
+    out = bytearray()
+    i = 1
+    while i < len(payload):
+        code = payload[i]
+        i += 1
+        if code < 0x80:
+            deltas = payload[i:i + code + 1]
+            i += code + 1
+        else:
+            deltas = [payload[i] if code >= 0xc0 else 0] * ((code & 0x3f) + 1)
+            i += code >= 0xc0
+        out.extend(deltas)
+    if len(out) != size or i != len(payload):
+        return None
+    return bytes((b + d) & 0xff for b, d in zip(base, out))
+
+
+DECODER_SHIM = r'''
+#define SMOOTHLED_HOST_PERIPHERALS
+#include <string.h>
+#include "SmoothLedBuffer.h"
+
+static SmoothLedBuffer<PACKET_SIZE, BUFFERED_FRAMES> buffer;
+
+extern "C" void codecReset() { buffer.reset(); }
+extern "C" void codecWrite(uint8_t time, const uint8_t* data) { memcpy(buffer.getWriteBuffer(time), data, PACKET_SIZE); }
+extern "C" bool codecDecode(uint8_t time, const uint8_t* data, uint8_t length)
+{
+    return buffer.decode(time, data, length);
+}
+// the entry for time, which must be the last one written
+extern "C" void codecRead(uint8_t time, uint8_t* out) { memcpy(out, buffer.getWriteBuffer(time), PACKET_SIZE); }
+'''
+
+
+def random_frame(rng, previous):
+    """Next frame: still, a few changes, a fade or all new."""
+    size = len(previous)
+    kind = rng.choice(['still', 'sparse', 'fade', 'fade', 'random'])
+    frame = bytearray(previous)
+    if kind == 'sparse':
+        for _ in range(rng.randint(1, 8)):
+            frame[rng.randrange(size)] = rng.randrange(256)
+    elif kind == 'fade':
+        start, end = sorted(rng.randrange(size + 1) for _ in range(2))
+        step = rng.choice([1, 2, 255, rng.randrange(256)])
+        for n in range(start, end):
+            frame[n] = (frame[n] + step) & 0xff
+    elif kind == 'random':
+        frame = bytearray(rng.randrange(256) for _ in range(size))
+    return bytes(frame)
+
+
+def round_trip(decoder, args, rng):
+    failures = 0
+    raw = compressed = 0
+    out = (ctypes.c_uint8 * args.size)()
+    for trial in range(args.trials):
+        decoder.codecReset()
+        held = [] # (time, frame) the receiver's ring should hold, oldest first
+        frame = bytes(rng.randrange(256) for _ in range(args.size))
+        time = rng.randrange(256)
+        failed = False
+        for n in range(args.frames):
+            time = (time + 1) & 0xff
+            frame = random_frame(rng, frame)
+            back = 0 if n == 0 else rng.choice([0, 1, 1, 1, rng.randint(1, args.buffered + 1)])
+            base = dict(held).get((time - back) & 0xff)
+            payload = encode(frame, base if back else None, back) if base or not back else \
+                encode(frame, bytes(args.size), back) # the base was lost
+            raw += args.size
+            if len(payload) >= args.size:
+                # no smaller, send it raw
+                decoder.codecWrite(time, frame)
+                compressed += args.size
+                ok = expected = True
+            else:
+                expected = decode(payload, base, args.size)
+                assert expected in (frame, None)
+                ok = decoder.codecDecode(time, payload, len(payload))
+                compressed += len(payload)
+            if ok != bool(expected):
+                print('MISMATCH trial %i frame %i: back %i decoded %i' % (trial, n, back, ok))
+                failed = True
+                break
+            if ok:
+                decoder.codecRead(time, out)
+                if bytes(out) != frame:
+                    print('MISMATCH trial %i frame %i: back %i wrong data' % (trial, n, back))
+                    failed = True
+                    break
+                held = (held + [(time, frame)])[-args.buffered:]
+        # malformed payloads are rejected
+        good = encode(frame)
+        for bad in (b'', b'\x00', b'\x00\x80', good[:-1], good + b'\x80', b'\x00\x7f' + bytes(127)):
+            if len(bad) < 256 and decoder.codecDecode(time, bad, len(bad)) != (decode(bad, None, args.size) is not None):
+                print('MISMATCH trial %i: payload %s' % (trial, bad.hex()))
+                failed = True
+        failures += failed
+    return failures, raw, compressed
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SmoothLed compressed packet round trip tests')
+    parser.add_argument('--trials', type=int, default=100, help='random frame sequences (default 100)')
+    parser.add_argument('--frames', type=int, default=50, help='frames per sequence (default 50)')
+    parser.add_argument('--size', type=int, default=150, help='packet size (default 150)')
+    parser.add_argument('--buffered', type=int, default=4, help='NumBufferedFrames (default 4)')
+    parser.add_argument('--seed', type=int, default=1, help='random seed')
+    args = parser.parse_args()
+
+    decoder = benchmarkUpdate.build_library({'PACKET_SIZE': args.size, 'BUFFERED_FRAMES': args.buffered},
+                                            DECODER_SHIM)
+    decoder.codecDecode.restype = ctypes.c_bool
+    failures, raw, compressed = round_trip(decoder, args, random.Random(args.seed))
+    print('%i/%i round trips matched' % (args.trials - failures, args.trials))
+    print('%i bytes raw, %i compressed (%.1f%%)' % (raw, compressed, 100.0 * compressed / raw))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,247 @@
+"""SmoothLedReceiver clock recovery simulation.
+
+Builds SmoothLedReceiver (with SmoothLedBuffer and SmoothLed) for the host, as
+benchmarkUpdate.py does, and feeds it a synthetic packet stream: a sender
+with its own frame clock (--drift), a network that adds jitter, loses,
+reorders and holds up packets in bursts, and a receiver calling update() once
+a tick.  Time is counted in receiver update() calls.  The animation sent is
+a sine wave, a few frames apart from one packet to the next.  Reported for each scenario:
+
+  lock      frames until the playout phase, averaged over --window frames,
+            comes within --tolerance of where it settles (the clock recovery
+            has locked)
+  slips     times it went outside the tolerance again after that
+  phase     RMS playout phase error once locked, in frames: how far the LEDs
+            wander from the sender's clock, less the receiver's delay
+  latency   mean frames from sending to showing once locked
+  error     RMS difference, in 8 bit levels, between each packet's level
+            as it reaches a frame and that frame's, once settled: what loss
+            concealment leaves
+  underrun  packet updates after locking that left the packet standing
+            still for want of a frame
+  dropped   packets that arrived too late to show
+  lost      packets the network lost
+
+The default scenarios make a regression benchmark for changes to the
+controller or the buffering; run it before and after with the same --seed.
+Requires python 3 and a host g++.  Examples:
+
+    python3 receiverSim.py
+    python3 receiverSim.py --jitter 30 --loss 0.1 --adaptive 1
+"""
+
+import argparse, ctypes, math, random, sys
+
+import benchmarkUpdate
+
+SIM_SHIM = r'''
+#define SMOOTHLED_HOST_PERIPHERALS
+#include <math.h>
+#include <string.h>
+#include "SmoothLedReceiver.h"
+
+// the animation sent: a sine wave on every channel but the second
+static uint8_t level(int32_t frame, uint8_t packet)
+{
+    return 128 + 100 * sin((frame + packet * 7) * (2 * M_PI / SINE_PERIOD));
+}
+
+// Runs ticks updates, delivering each packet at the start of its arrival
+// tick and noting those that were too late.  For each tick: the playout
+// position in 1/0x8000ths of a frame (INT32_MIN before locking) and delay,
+// and when update() moved a packet on to its next frame, how far its level
+// was from the frame it had got to (in 8 bit levels times 256) and whether
+// it was left standing still.
+extern "C" void simRun(uint32_t ticks, uint32_t numPackets, const uint32_t* arrival, const int32_t* frame,
+    const uint8_t* packet, bool adaptive, uint8_t extrapolation, uint8_t minUpdatesPerFrame, uint8_t* late,
+    int32_t* position, uint16_t* delay, uint8_t* updated, int32_t* error, uint8_t* underrun)
+{
+    static SmoothLedReceiver<PACKETS, PACKET_SIZE, BUFFERED_FRAMES>* receiver;
+    delete receiver;
+    receiver = new SmoothLedReceiver<PACKETS, PACKET_SIZE, BUFFERED_FRAMES>;
+    receiver->setAdaptiveDelay(adaptive);
+    receiver->setExtrapolation(extrapolation);
+    SmoothLed& leds = receiver->getLeds();
+    static uint8_t output[PACKETS * PACKET_SIZE];
+    int32_t lastReceived = 0;
+    uint32_t next = 0;
+    for (uint32_t t = 0; t < ticks; ++t)
+    {
+        for (; next < numPackets && arrival[next] <= t; ++next)
+        {
+            uint8_t* data = receiver->receive(frame[next], packet[next]);
+            late[next] = !data;
+            if (data)
+            {
+                memset(data, level(frame[next], packet[next]), PACKET_SIZE);
+                data[1] = frame[next] * 7; // never still
+            }
+            if (frame[next] > lastReceived)
+                lastReceived = frame[next];
+        }
+        uint8_t u = receiver->update(minUpdatesPerFrame);
+        // the receiver's 8 bit frame is within 128 of the last received
+        int32_t current = lastReceived - int8_t(uint8_t(lastReceived) - receiver->getFrame());
+        bool locked = leds.getFadeRate() != 0;
+        position[t] = locked ? current * 0x8000 + leds.getFadePosition() : INT32_MIN;
+        delay[t] = receiver->getDelay();
+        updated[t] = locked && u < PACKETS ? u : 0xff;
+        error[t] = 0;
+        underrun[t] = 0;
+        if (updated[t] != 0xff)
+        {
+            // by now the packet has faded all the way to the current frame
+            const SmoothLed::Interpolator& i = leds.getInterpolator(u * PACKET_SIZE);
+            error[t] = (int32_t(i.getValue()) - leds.expandRange(level(current, u))) * 255 * 256 / leds.expandRange(255);
+            underrun[t] = leds.getInterpolator(u * PACKET_SIZE + 1).step == 0;
+        }
+        leds.update(output);
+    }
+}
+'''
+
+SCENARIOS = {
+    'clean':   {},
+    'fast':    {'drift': 2},
+    'slow':    {'drift': -2},
+    'jitter':  {'jitter': 20},
+    'loss':    {'loss': 0.05},
+    'reorder': {'reorder': 0.05},
+    'burst':   {'burst': 80},
+    'all':     {'drift': 1, 'jitter': 10, 'loss': 0.02, 'reorder': 0.02, 'burst': 60},
+}
+NETWORK = {'drift': 0.0, 'jitter': 0.0, 'loss': 0.0, 'reorder': 0.0, 'burst': 0.0}
+
+
+def schedule(net, args, rng):
+    """(arrival tick, frame, packet) of every packet that gets through, and
+    how many were lost."""
+    period = args.period * (1 + net['drift'] / 100)
+    packets = []
+    lost = 0
+    hold_until = 0
+    for f in range(args.frames):
+        sent = f * period
+        # a burst holds everything up for a while then lets it through
+        if net['burst'] and f % args.burst_every == args.burst_every // 2:
+            hold_until = sent + net['burst']
+        for p in range(args.packets):
+            if rng.random() < net['loss']:
+                lost += 1
+                continue
+            t = sent + p + rng.uniform(0, net['jitter'])
+            if rng.random() < net['reorder']:
+                t += args.period * 1.5
+            packets.append((max(t, hold_until), f, p))
+    packets.sort(key=lambda packet: packet[0])
+    return [(math.ceil(t), f, p) for t, f, p in packets], lost, period
+
+
+def simulate(library, net, args):
+    rng = random.Random(args.seed)
+    packets, lost, period = schedule(net, args, rng)
+    ticks = int(args.frames * period)
+    n = len(packets)
+    arrays = dict(position=ctypes.c_int32 * ticks, delay=ctypes.c_uint16 * ticks,
+                  updated=ctypes.c_uint8 * ticks, error=ctypes.c_int32 * ticks, underrun=ctypes.c_uint8 * ticks)
+    out = dict((k, v()) for k, v in arrays.items())
+    late = (ctypes.c_uint8 * n)()
+    library.simRun(ticks, n, (ctypes.c_uint32 * n)(*[p[0] for p in packets]),
+                   (ctypes.c_int32 * n)(*[p[1] for p in packets]), (ctypes.c_uint8 * n)(*[p[2] for p in packets]),
+                   args.adaptive, args.extrapolation, args.min_updates, late, out['position'], out['delay'],
+                   out['updated'], out['error'], out['underrun'])
+
+    locked = [t for t in range(ticks) if out['position'][t] != -2 ** 31]
+    if not locked:
+        return None
+    # phase error: sender frames minus frames shown, less the intended delay
+    latency = dict((t, t / period - out['position'][t] / 0x8000) for t in locked)
+    error = dict((t, latency[t] - out['delay'][t] / 256) for t in locked)
+    settled = [t for t in locked if t >= ticks * args.settle]
+    mean = sum(error[t] for t in settled) / len(settled)
+    # the error averaged over --window frames to take out the jitter is
+    # within the tolerance from locking on, bar slips
+    window = int(args.window * period)
+    sums, unlocked = [0.0], [0]
+    for t in range(ticks):
+        sums.append(sums[-1] + error.get(t, 0))
+        unlocked.append(unlocked[-1] + (t not in error))
+    lock = None
+    slips = 0
+    inside = False
+    for t in range(ticks - window):
+        was = inside
+        inside = unlocked[t + window] == unlocked[t] and \
+            abs((sums[t + window] - sums[t]) / window - mean) <= args.tolerance
+        if inside and lock is None:
+            lock = t
+        slips += was and not inside
+    if lock is None:
+        return dict(lock=None, lost=lost)
+    steady = range(lock, ticks)
+    phase = math.sqrt(sum((error[t] - mean) ** 2 for t in steady) / len(steady))
+    updates = [t for t in steady if out['updated'][t] != 0xff]
+    settled = [t for t in updates if t >= ticks * args.settle]
+    level_error = math.sqrt(sum((out['error'][t] / 256) ** 2 for t in settled) / len(settled))
+    underruns = sum(out['underrun'][t] for t in updates)
+    # the buffers are emptied on locking
+    dropped = sum(late[n] for n in range(len(packets)) if packets[n][0] > lock)
+    return dict(lock=lock / period, slips=slips, phase=phase, latency=sum(latency[t] for t in steady) / len(steady),
+                error=level_error, underrun=underruns, dropped=dropped, lost=lost)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SmoothLedReceiver clock recovery simulation')
+    parser.add_argument('--scenario', action='append', choices=sorted(SCENARIOS),
+                        help='scenario to run, repeatable (default all of them unless network options are given)')
+    parser.add_argument('--drift', type=float, help='sender clock fast by this many percent')
+    parser.add_argument('--jitter', type=float, help='uniform packet delay of up to this many ticks')
+    parser.add_argument('--loss', type=float, help='fraction of packets lost')
+    parser.add_argument('--reorder', type=float, help='fraction of packets held back 1.5 frames')
+    parser.add_argument('--burst', type=float, help='ticks the network stalls for every --burst-every frames')
+    parser.add_argument('--burst-every', type=int, default=200, help='frames between bursts (default 200)')
+    parser.add_argument('--frames', type=int, default=3000, help='frames sent (default 3000)')
+    parser.add_argument('--period', type=float, default=40, help='receiver update() calls per frame (default 40)')
+    parser.add_argument('--min-updates', type=int, default=25, help='update() minUpdatesPerFrame (default 25)')
+    parser.add_argument('--packets', type=int, default=2, help='PacketsPerFrame (default 2)')
+    parser.add_argument('--packet-size', type=int, default=16, help='PacketSize, at least 2 (default 16)')
+    parser.add_argument('--buffered', type=int, default=4, help='NumBufferedFrames (default 4)')
+    parser.add_argument('--adaptive', type=int, default=0, help='setAdaptiveDelay (default 0)')
+    parser.add_argument('--extrapolation', type=int, default=1, help='setExtrapolation (default 1)')
+    parser.add_argument('--sine-period', type=int, default=50, help='frames per cycle of the animation (default 50)')
+    parser.add_argument('--tolerance', type=float, default=0.1, help='phase error counted as locked, in frames (default 0.1)')
+    parser.add_argument('--window', type=float, default=8, help='frames the phase is averaged over for lock (default 8)')
+    parser.add_argument('--settle', type=float, default=0.5,
+                        help='fraction of the run after which the phase has settled (default 0.5)')
+    parser.add_argument('--seed', type=int, default=1, help='random seed')
+    parser.add_argument('-D', dest='defines', action='append', default=[],
+                        help='NAME=VALUE configuration define for the library')
+    args = parser.parse_args()
+    defines = dict((d.split('=', 1) + ['1'])[:2] for d in args.defines)
+    defines.update(SINE_PERIOD=args.sine_period, PACKETS=args.packets, PACKET_SIZE=args.packet_size, BUFFERED_FRAMES=args.buffered)
+
+    custom = dict((k, getattr(args, k)) for k in NETWORK if getattr(args, k) is not None)
+    if custom:
+        scenarios = [('custom', dict(NETWORK, **custom))]
+    else:
+        scenarios = [(name, dict(NETWORK, **SCENARIOS[name])) for name in args.scenario or SCENARIOS]
+
+    library = benchmarkUpdate.build_library(defines, SIM_SHIM)
+    print('%i frames of %g updates, %i packets of %i, %i buffered, adaptive delay %s, extrapolating %i'
+          % (args.frames, args.period, args.packets, args.packet_size, args.buffered,
+             'on' if args.adaptive else 'off', args.extrapolation))
+    print('%-10s %8s %6s %8s %8s %8s %9s %8s %8s' % ('scenario', 'lock', 'slips', 'phase', 'latency', 'error',
+                                                      'underrun', 'dropped', 'lost'))
+    for name, net in scenarios:
+        r = simulate(library, net, args)
+        if r is None or r['lock'] is None:
+            print('%-10s %8s' % (name, 'never'))
+        else:
+            print('%-10s %8.1f %6i %8.3f %8.2f %8.2f %9i %8i %8i' % (
+                name, r['lock'], r['slips'], r['phase'], r['latency'], r['error'], r['underrun'], r['dropped'],
+                r['lost']))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,288 @@
+"""SmoothLedSequence keyframe animations.
+
+encode() turns keyframes, each (frames to fade over, channel targets), into
+the byte sequence SmoothLedSequence plays from flash: the channel count, then
+for each keyframe its frame count (both 2 bytes little endian) and runs of
+
+    0x00-0x7f  code + 1 targets follow, one for each channel
+    0x80-0xbf  code - 0x7f channels keep the previous keyframe's target
+    0xc0-0xff  code - 0xbf channels all fade to the target that follows
+
+and a frame count of 0 at the end.  This is the same code space as
+packetCodec.py but with whole targets rather than deltas, so the player can
+pass them straight from flash to setFadeTarget with no copy of the last
+keyframe in SRAM.  Channels that don't change and runs of one colour shrink
+to a byte or two.
+
+Keyframes are read from a text file, one per line: the frames to fade over
+then every channel's target (decimal or 0x hex, spaces or commas), with #
+starting a comment.  The output is a C array to paste into a sketch:
+
+    python3 sequenceCodec.py animation.txt --name animation > animation.h
+
+--check plays random sequences through the C++ player built for the host
+(see benchmarkUpdate.py) against a strip given every keyframe's targets
+channel by channel, and reports the compression:
+
+    python3 sequenceCodec.py --check --trials 50
+"""
+
+import argparse, ctypes, random, re, sys
+
+MAX_LITERALS = 0x80
+MAX_RUN = 0x40
+MAX_FRAMES = 0xffff
+
+
+def encode(keyframes):
+    """Sequence for a list of (frames, targets), all the same length."""
+    if not keyframes:
+        raise ValueError('no keyframes')
+    size = len(keyframes[0][1])
+    if not 0 < size <= 0xffff:
+        raise ValueError('bad channel count %i' % size)
+    out = bytearray(size.to_bytes(2, 'little'))
+    previous = None
+    for frames, targets in keyframes:
+        if len(targets) != size:
+            raise ValueError('keyframe has %i channels, expected %i' % (len(targets), size))
+        if not 0 < frames <= MAX_FRAMES:
+            raise ValueError('keyframe fades over %i frames, must be 1 to %i' % (frames, MAX_FRAMES))
+        out.extend(frames.to_bytes(2, 'little'))
+        out.extend(encode_runs(targets, previous))
+        previous = targets
+    out.extend(bytes(2))
+    return bytes(out)
+
+
+def encode_runs(targets, previous):
+    out = bytearray()
+    literals = []
+
+    def flush():
+        if literals:
+            out.append(len(literals) - 1)
+            out.extend(literals)
+            del literals[:]
+
+    i = 0
+    while i < len(targets):
+        # the first keyframe sets every channel, there's nothing to keep
+        same = 0
+        while previous is not None and i + same < len(targets) and same < MAX_RUN and \
+                targets[i + same] == previous[i + same]:
+            same += 1
+        run = 1
+        while i + run < len(targets) and run < MAX_RUN and targets[i + run] == targets[i]:
+            run += 1
+        # as in packetCodec, a kept run is worth breaking a literal run for
+        # at 2 and a repeat at 3
+        if same and (same >= 2 or not literals) and same >= run:
+            flush()
+            out.append(0x80 + same - 1)
+            i += same
+        elif run >= 3:
+            flush()
+            out.extend((0xc0 + run - 1, targets[i]))
+            i += run
+        else:
+            literals.append(targets[i])
+            if len(literals) == MAX_LITERALS:
+                flush()
+            i += 1
+    flush()
+    return out
+
+
+def decode(sequence, kept=None):
+    """Python version of the player, the list of (frames, targets).  Also
+    appends to kept, for each keyframe, whether each channel was left to keep
+    its target."""
+    size = int.from_bytes(sequence[:2], 'little')
+    keyframes = []
+    targets = [None] * size
+    i = 2
+    while True:
+        frames = int.from_bytes(sequence[i:i + 2], 'little')
+        i += 2
+        if frames == 0:
+            break
+        targets = list(targets)
+        keep = [False] * size
+        n = 0
+        while n < size:
+            code = sequence[i]
+            i += 1
+            run = (code & (0x3f if code & 0x80 else 0x7f)) + 1
+            if code < 0x80:
+                targets[n:n + run] = sequence[i:i + run]
+                i += run
+            elif code >= 0xc0:
+                targets[n:n + run] = [sequence[i]] * run
+                i += 1
+            else:
+                keep[n:n + run] = [True] * run
+            n += run
+        keyframes.append((frames, targets))
+        if kept is not None:
+            kept.append(keep)
+    if i != len(sequence):
+        raise ValueError('%i bytes after the end' % (len(sequence) - i))
+    return keyframes
+
+
+def read_keyframes(f):
+    keyframes = []
+    for number, line in enumerate(f, 1):
+        fields = re.split(r'[\s,]+', line.split('#')[0].strip())
+        if fields == ['']:
+            continue
+        try:
+            values = [int(v, 0) for v in fields]
+        except ValueError:
+            raise ValueError('line %i: not a number' % number)
+        if len(values) < 2 or any(not 0 <= v <= 255 for v in values[1:]):
+            raise ValueError('line %i: expected frames then targets of 0 to 255' % number)
+        keyframes.append((values[0], values[1:]))
+    return keyframes
+
+
+def print_array(sequence, name):
+    print('// %i bytes, made by sequenceCodec.py' % len(sequence))
+    print('const uint8_t %s[%i] =' % (name, len(sequence)))
+    print('{')
+    for n in range(0, len(sequence), 16):
+        print('    ' + ' '.join('0x%02x,' % b for b in sequence[n:n + 16]))
+    print('};')
+
+
+PLAYER_SHIM = r'''
+#define SMOOTHLED_HOST_PERIPHERALS
+#include "SmoothLedSequence.h"
+
+static SmoothLed::Interpolator played[CHANNELS], expected[CHANNELS];
+
+// Plays sequence on one strip while the other is given each keyframe's
+// targets one channel at a time, stopping the ones kept, returning the frames
+// until the outputs first differ (or -2 if they don't).
+extern "C" int checkSequence(const uint8_t* sequence, const uint8_t* keyframes, const uint8_t* kept,
+    const uint16_t* frames, int numKeyframes, bool loop)
+{
+    SmoothLed a(played, CHANNELS, SmoothLed::DITHER0), b(expected, CHANNELS, SmoothLed::DITHER0);
+    a.clear();
+    b.clear();
+    SmoothLedSequence player(a);
+    if (!player.play(sequence, loop))
+        return -1;
+    int frame = 0;
+    for (int pass = 0; pass < (loop ? 2 : 1); ++pass)
+    {
+        for (int k = 0; k < numKeyframes; ++k)
+        {
+            for (int c = 0; c < CHANNELS; ++c)
+            {
+                if (kept[k * CHANNELS + c])
+                    b.clearFadeTarget(c, 1);
+                else
+                    b.setFadeTarget(c, keyframes[k * CHANNELS + c]);
+            }
+            b.beginFade(frames[k]);
+            do {
+                player.update();
+                if (player.getKeyframe() != k)
+                    return frame;
+                uint8_t x[CHANNELS], y[CHANNELS];
+                a.update(x);
+                b.update(y);
+                for (int c = 0; c < CHANNELS; ++c)
+                    if (x[c] != y[c])
+                        return frame;
+                ++frame;
+            } while (b.isFading());
+        }
+    }
+    // run out unless looping
+    if (player.update() != loop)
+        return frame;
+    return -2;
+}
+'''
+
+
+def random_keyframes(rng, size, count):
+    """Keyframes that hold, change a few channels, fill or change everything."""
+    targets = [rng.randrange(256) for _ in range(size)]
+    keyframes = []
+    for _ in range(count):
+        kind = rng.choice(['hold', 'sparse', 'fill', 'random'])
+        targets = list(targets)
+        if kind == 'sparse':
+            for _ in range(rng.randint(1, 8)):
+                targets[rng.randrange(size)] = rng.randrange(256)
+        elif kind == 'fill':
+            start, end = sorted(rng.randrange(size + 1) for _ in range(2))
+            targets[start:end] = [rng.choice([0, 255, rng.randrange(256)])] * (end - start)
+        elif kind == 'random':
+            targets = [rng.randrange(256) for _ in range(size)]
+        keyframes.append((rng.choice([1, 2, rng.randint(1, 40)]), targets))
+    return keyframes
+
+
+def check(args):
+    import benchmarkUpdate
+    player = benchmarkUpdate.build_library({'CHANNELS': args.size}, PLAYER_SHIM)
+    rng = random.Random(args.seed)
+    failures = raw = compressed = 0
+    for trial in range(args.trials):
+        keyframes = random_keyframes(rng, args.size, args.keyframes)
+        sequence = encode(keyframes)
+        kept = []
+        assert decode(sequence, kept) == keyframes
+        assert not any(kept[0])
+        raw += args.size * len(keyframes)
+        compressed += len(sequence)
+        flat = bytes(v for _, targets in keyframes for v in targets)
+        frames = (ctypes.c_uint16 * len(keyframes))(*[f for f, _ in keyframes])
+        loop = trial & 1
+        result = player.checkSequence(sequence, flat, bytes(k for keep in kept for k in keep), frames,
+                                      len(keyframes), ctypes.c_bool(loop))
+        if result < 0 and result != -2:
+            print('MISMATCH trial %i: play rejected the sequence' % trial)
+            failures += 1
+        elif result >= 0:
+            print('MISMATCH trial %i: outputs differ at frame %i' % (trial, result))
+            failures += 1
+    print('%i/%i sequences matched' % (args.trials - failures, args.trials))
+    print('%i bytes of targets, %i encoded (%.1f%%)' % (raw, compressed, 100.0 * compressed / raw))
+    return 1 if failures else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SmoothLedSequence keyframe encoder')
+    parser.add_argument('input', nargs='?', help='keyframe text file (default stdin)')
+    parser.add_argument('--name', default='sequence', help='C array name (default sequence)')
+    parser.add_argument('--check', action='store_true', help='play random sequences through the C++ player')
+    parser.add_argument('--trials', type=int, default=50, help='--check: random sequences (default 50)')
+    parser.add_argument('--keyframes', type=int, default=12, help='--check: keyframes per sequence (default 12)')
+    parser.add_argument('--size', type=int, default=90, help='--check: channels (default 90)')
+    parser.add_argument('--seed', type=int, default=1, help='--check: random seed')
+    args = parser.parse_args()
+    if args.check:
+        return check(args)
+
+    try:
+        if args.input:
+            with open(args.input) as f:
+                keyframes = read_keyframes(f)
+        else:
+            keyframes = read_keyframes(sys.stdin)
+        sequence = encode(keyframes)
+    except ValueError as e:
+        print('error: %s' % e, file=sys.stderr)
+        return 1
+    print_array(sequence, args.name)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
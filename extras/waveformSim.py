@@ -0,0 +1,314 @@
+"""SmoothLedCcl output waveform model.
+
+Builds SmoothLedCcl for the host with the given F_CPU, runs beginTimer,
+beginCclLut and beginTransaction for a clock setting and pulse widths, and
+takes the TCB compare value, the CCL truth table and the SPI prescaler or
+USART baud setting from the registers they wrote.  It then clocks a byte
+stream through a model of the hardware and prints the LED data line's edges,
+checks every bit against an LED's timing and reports the bit rate and frame
+time.  With --search it looks for the fastest setting that passes.
+
+The model, per bit of the stream (sent MSB first, 2 * H CPU cycles each):
+
+  SCK      high for the first H cycles, low for the second; H is BAUD >> 6
+           for the USART in master SPI mode and half the SPI prescaler
+  MOSI     the bit, from the rising clock edge (UCPHA for the USART); when
+           the CPU falls behind the USART's TXD idles high and SPI's MOSI
+           keeps the last bit
+  TCB      single shot started by the rising clock edge: high from
+           --tcb-delay cycles after it for CCMP + 1 cycles, and deaf to
+           edges while it runs.  The default delay of 5 cycles is what the
+           "- 5" in beginTimer allows for
+  output   the LUT (IN0 = SCK, IN1 = MOSI, IN2 = TCB), 0 outside the
+           transaction
+
+so a 0 on the wire gives a long pulse for the whole low half of SCK (an LED
+1, the output is inverted) and a 1 gives the TCB pulse left after SCK falls.
+The CCL's propagation delay is the same for both edges and left out.  The
+delay and the idle levels are the parts to check against a scope trace
+before trusting the margins to the last cycle.
+
+A bit fails if its high time is outside the LED's datasheet window, if its
+low time is under the datasheet minimum or long enough for the LED to latch,
+or if the pulses don't decode back to the data.  Low times over the datasheet
+maximum (but under the latch time) are warnings; LEDs wait for the next
+rising edge.  Examples:
+
+    python3 waveformSim.py --f-cpu 16000000 --clock PB1_USART0_ASYNCCH1 --low 300 --high 750 --led ws2812b
+    python3 waveformSim.py --f-cpu 10000000 --clock PA3_SPI0_ASYNCCH0 --search --led sk6812
+    python3 waveformSim.py --low 300 --high 750 --gap 40 --vcd frame.vcd
+"""
+
+import argparse, ctypes, random, sys
+
+import benchmarkUpdate
+
+CLOCK_SETTINGS = ['PA3_USART0_ASYNCCH0', 'PA3_SPI0_ASYNCCH0', 'PB1_USART0_ASYNCCH1', 'PC0_SPI0_ASYNCCH2']
+
+# datasheet T0H, T1H, T0L, T1L and their tolerance in ns, and the shortest
+# low time that latches the data (the reset time) in us
+LEDS = {
+    'ws2812': (350, 700, 800, 600, 150, 50),
+    'ws2812b': (400, 800, 850, 450, 150, 50),
+    'sk6812': (300, 600, 900, 600, 150, 80),
+}
+
+CCL_SHIM = r'''
+#define SMOOTHLED_HOST_PERIPHERALS
+#include "SmoothLedCcl.h"
+
+// the peripheral settings SmoothLedCcl::begin makes for sck and the pulse widths
+extern "C" void cclSetup(uint8_t sck, int lowPulseNs, int highPulseNs,
+    uint16_t* ccmp, uint8_t* halfBit, uint8_t* truth, uint8_t* spi)
+{
+    SmoothLedCcl ccl;
+    ccl.beginTimer(SmoothLedCcl::ClockSetting(sck), TCB0, lowPulseNs, highPulseNs);
+    ccl.beginCclLut(SmoothLedCcl::LUT0, TCB0);
+    ccl.beginTransaction();
+    *ccmp = TCB0.CCMP;
+    *truth = CCL.TRUTH0;
+    *spi = ccl.isSpi();
+    if (*spi)
+    {
+        // SCK is the peripheral clock divided by 4, 16, 64 or 128, doubled by CLK2X
+        static const uint8_t dividers[] = { 4, 16, 64, 128 };
+        uint8_t divider = dividers[(SPI0.CTRLA & SPI_PRESC_gm) >> 1];
+        if (SPI0.CTRLA & SPI_CLK2X_bm)
+            divider /= 2;
+        *halfBit = divider / 2;
+    }
+    else
+    {
+        // master SPI mode USART: one bit every 2 * BAUD[15:6] cycles
+        *halfBit = USART0.BAUD >> 6;
+    }
+}
+'''
+
+
+class Setup:
+    """Registers SmoothLedCcl sets up for a clock setting and pulse widths."""
+
+    def __init__(self, ccl, f_cpu, clock, low_ns, high_ns):
+        ccmp, half_bit, truth, spi = ctypes.c_uint16(), ctypes.c_uint8(), ctypes.c_uint8(), ctypes.c_uint8()
+        ccl.cclSetup(CLOCK_SETTINGS.index(clock), low_ns, high_ns,
+                     ctypes.byref(ccmp), ctypes.byref(half_bit), ctypes.byref(truth), ctypes.byref(spi))
+        self.f_cpu = f_cpu
+        self.clock = clock
+        self.low_ns, self.high_ns = low_ns, high_ns
+        self.ccmp = ccmp.value
+        self.half_bit = half_bit.value
+        self.truth = truth.value
+        self.spi = bool(spi.value)
+
+    def ns(self, cycles):
+        return cycles * 1e9 / self.f_cpu
+
+
+def simulate(setup, data, tcb_delay, gap=0):
+    """Per cycle SCK, MOSI, TCB and output levels for sending data."""
+    h = setup.half_bit
+    sck, mosi = [], []
+    for byte in data:
+        for b in range(7, -1, -1):
+            bit = (byte >> b) & 1
+            sck += [1] * h + [0] * h
+            mosi += [bit] * (2 * h)
+        sck += [0] * gap
+        mosi += [bit if setup.spi else 1] * gap
+    tcb = [0] * len(sck)
+    running_until = 0
+    for t in range(len(sck)):
+        if sck[t] and (t == 0 or not sck[t - 1]) and t >= running_until:
+            running_until = t + tcb_delay + setup.ccmp + 1
+            for c in range(t + tcb_delay, min(running_until, len(tcb))):
+                tcb[c] = 1
+    out = [(setup.truth >> (s | (m << 1) | (c << 2))) & 1 for s, m, c in zip(sck, mosi, tcb)]
+    return sck, mosi, tcb, out
+
+
+def pulses(out):
+    """(rise, fall) cycle of every high pulse, the line is low before and after."""
+    result = []
+    level = 0
+    for t, v in enumerate(out + [0]):
+        if v and not level:
+            rise = t
+        elif level and not v:
+            result.append((rise, t))
+        level = v
+    return result
+
+
+class Check:
+    """Timing of one send of data against an LED's datasheet."""
+
+    def __init__(self, setup, data, led, tcb_delay, gap=0, tolerance=None):
+        t0h, t1h, t0l, t1l, tol, reset_us = LEDS[led]
+        if tolerance is not None:
+            tol = tolerance
+        self.errors = []
+        self.warnings = []
+        # observed [min, max] ns of each time, and the worst margin to its window
+        self.times = {}
+        _, _, _, out = simulate(setup, data, tcb_delay, gap)
+        self.cycles = len(out)
+        found = pulses(out)
+        bits = [((byte >> b) & 1) ^ 1 for byte in data for b in range(7, -1, -1)]
+        if len(found) != len(bits):
+            self.errors.append('%i pulses for %i bits' % (len(found), len(bits)))
+            return
+        threshold = (t0h + t1h) / 2
+        for n, (bit, (rise, fall)) in enumerate(zip(bits, found)):
+            high = setup.ns(fall - rise)
+            if (high > threshold) != bit:
+                self.errors.append('bit %i of byte %i decodes as %i' % (7 - n % 8, n // 8, bit ^ 1))
+            self.record('T%iH' % bit, high, (t1h if bit else t0h) - tol, (t1h if bit else t0h) + tol, n)
+            if n + 1 < len(found):
+                low = setup.ns(found[n + 1][0] - fall)
+                nominal = t1l if bit else t0l
+                if low >= reset_us * 1000:
+                    self.errors.append('%.0fns low after bit %i of byte %i latches the LEDs' % (low, 7 - n % 8, n // 8))
+                self.record('T%iL' % bit, low, nominal - tol, nominal + tol, n, warn_over=True)
+
+    def record(self, name, value, lo, hi, n, warn_over=False):
+        seen = self.times.setdefault(name, [value, value, lo, hi])
+        seen[0] = min(seen[0], value)
+        seen[1] = max(seen[1], value)
+        where = 'bit %i of byte %i' % (7 - n % 8, n // 8)
+        if value < lo:
+            self.errors.append('%s %.0fns under %.0fns at %s' % (name, value, lo, where))
+        elif value > hi:
+            (self.warnings if warn_over else self.errors).append(
+                '%s %.0fns over %.0fns at %s' % (name, value, hi, where))
+
+    def margin(self):
+        """Smallest distance in ns of a high time from the edges of its window."""
+        return min(min(v0 - lo, hi - v1) for name, (v0, v1, lo, hi) in self.times.items() if name.endswith('H'))
+
+
+def test_data(rng, count):
+    """Every byte value pattern that matters plus random bytes."""
+    return bytes([0x00, 0xff, 0x55, 0xaa, 0x0f, 0xf0, 0x01, 0x80] + [rng.randrange(256) for _ in range(count)])
+
+
+def write_vcd(path, setup, sck, mosi, tcb, out):
+    names = [('sck', sck), ('mosi', mosi), ('tcb', tcb), ('led', out)]
+    with open(path, 'w') as f:
+        f.write('$timescale 1ns $end\n$scope module smoothled $end\n')
+        for n, (name, _) in enumerate(names):
+            f.write('$var wire 1 %s %s $end\n' % (chr(33 + n), name))
+        f.write('$upscope $end\n$enddefinitions $end\n')
+        previous = None
+        for t, levels in enumerate(zip(*[s for _, s in names])):
+            if levels != previous:
+                f.write('#%i\n' % round(setup.ns(t)))
+                for n, v in enumerate(levels):
+                    if previous is None or previous[n] != v:
+                        f.write('%i%s\n' % (v, chr(33 + n)))
+                previous = levels
+        f.write('#%i\n' % round(setup.ns(len(out))))
+
+
+def report(ccl, args, rng):
+    setup = Setup(ccl, args.f_cpu, args.clock, args.low, args.high)
+    h = setup.half_bit
+    led = LEDS[args.led]
+    print('%s at %.1fMHz, lowPulseNs %i, highPulseNs %i' % (args.clock, args.f_cpu / 1e6, args.low, args.high))
+    print('  %s, half bit %i cycles, CCMP %i, truth table 0x%02x'
+          % ('SPI' if setup.spi else 'USART', h, setup.ccmp, setup.truth))
+    print('  bit %i cycles (%.0fns), %.0fkbit/s' % (2 * h, setup.ns(2 * h), args.f_cpu / (2 * h) / 1000))
+
+    data = test_data(rng, args.bytes)
+    sck, mosi, tcb, out = simulate(setup, data, args.tcb_delay, args.gap)
+    if args.vcd:
+        write_vcd(args.vcd, setup, sck, mosi, tcb, out)
+    if args.edges:
+        print('  first edges (ns): ' + ' '.join(
+            '%s%.0f' % ('+' if rise else '-', setup.ns(t))
+            for p in pulses(out)[:args.edges] for t, rise in ((p[0], True), (p[1], False))))
+
+    failed = False
+    for delay in sorted(set([args.tcb_delay - 1, args.tcb_delay, args.tcb_delay + 1])):
+        check = Check(setup, data, args.led, delay, args.gap, args.tolerance)
+        label = 'TCB delay %i%s' % (delay, '' if delay == args.tcb_delay else ' (scope check)')
+        print('%s against %s: %s' % (label, args.led, 'FAIL' if check.errors else 'pass'))
+        for name in sorted(check.times):
+            v0, v1, lo, hi = check.times[name]
+            print('  %s %6.0f-%-6.0f ns  (datasheet %.0f-%.0f)' % (name, v0, v1, lo, hi))
+        for message in check.errors[:args.show]:
+            print('  error: ' + message)
+        if len(check.errors) > args.show:
+            print('  ... %i errors' % len(check.errors))
+        for message in check.warnings[:1]:
+            print('  warning: %s (and %i more)' % (message, len(check.warnings) - 1))
+        failed |= delay == args.tcb_delay and bool(check.errors)
+
+    frame = setup.ns(args.leds * 8 * 2 * h + args.leds * args.gap) / 1000
+    reset = led[5]
+    print('%i bytes: %.1fus + %ius reset = %.0f frames/s at most'
+          % (args.leds, frame, reset, 1e6 / (frame + reset)))
+    return failed
+
+
+def search(ccl, args, rng):
+    """Fastest bit with the most high time margin that passes at every TCB delay in the range."""
+    data = test_data(rng, 24)
+    mhz = args.f_cpu / 1e6
+    ns = lambda cycles: int(cycles * 1000 / mhz)  # nsToCycles rounds back up to cycles
+    spi = 'SPI' in args.clock
+    candidates = [4, 8, 16] if spi else range(4, 64)
+    best = None
+    for h in candidates:
+        for low in range(1, 2 * h):
+            setup = Setup(ccl, args.f_cpu, args.clock, ns(low), ns(h))
+            checks = [Check(setup, data, args.led, d, 0, args.tolerance)
+                      for d in (args.tcb_delay - 1, args.tcb_delay, args.tcb_delay + 1)]
+            if any(c.errors for c in checks):
+                continue
+            margin = min(c.margin() for c in checks)
+            if best is None or margin > best[0]:
+                best = (margin, setup)
+        if best:
+            break
+    if not best:
+        print('no setting of %s at %.1fMHz meets the %s timing' % (args.clock, mhz, args.led))
+        return True
+    margin, setup = best
+    bit = setup.ns(2 * setup.half_bit)
+    print('%s at %.1fMHz for %s: begin(..., lowPulseNs = %i, highPulseNs = %i)'
+          % (args.clock, mhz, args.led, setup.low_ns, setup.high_ns))
+    print('  bit %.0fns (%.0fkbit/s), high times within %.0fns of the datasheet limits at TCB delay %i-%i'
+          % (bit, 1e6 / bit, margin, args.tcb_delay - 1, args.tcb_delay + 1))
+    return False
+
+
+def main():
+    parser = argparse.ArgumentParser(description='SmoothLedCcl output waveform model')
+    parser.add_argument('--f-cpu', type=int, default=16000000, help='CPU clock in Hz (default 16000000)')
+    parser.add_argument('--clock', choices=CLOCK_SETTINGS, default='PB1_USART0_ASYNCCH1',
+                        help='SmoothLedCcl::ClockSetting (default PB1_USART0_ASYNCCH1)')
+    parser.add_argument('--low', type=int, default=200, help='lowPulseNs (default 200)')
+    parser.add_argument('--high', type=int, default=600, help='highPulseNs (default 600)')
+    parser.add_argument('--led', choices=sorted(LEDS), default='ws2812b', help='LED timing (default ws2812b)')
+    parser.add_argument('--tolerance', type=int, help='override the datasheet tolerance in ns')
+    parser.add_argument('--tcb-delay', type=int, default=5,
+                        help='cycles from the SCK edge to the TCB output (default 5, also checks +-1)')
+    parser.add_argument('--gap', type=int, default=0, help='idle cycles after every byte (CPU not keeping up)')
+    parser.add_argument('--bytes', type=int, default=64, help='random bytes to check (default 64)')
+    parser.add_argument('--leds', type=int, default=150, help='bytes per frame for the frame time (default 150)')
+    parser.add_argument('--edges', type=int, default=0, help='print the first N pulses')
+    parser.add_argument('--show', type=int, default=4, help='errors to list (default 4)')
+    parser.add_argument('--vcd', help='write the signals to a VCD file')
+    parser.add_argument('--search', action='store_true', help='find the fastest passing pulse widths')
+    parser.add_argument('--seed', type=int, default=1, help='random seed')
+    args = parser.parse_args()
+
+    ccl = benchmarkUpdate.build_library({'F_CPU': '%iUL' % args.f_cpu}, CCL_SHIM)
+    rng = random.Random(args.seed)
+    failed = search(ccl, args, rng) if args.search else report(ccl, args, rng)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -3,10 +3,6 @@
 
 using namespace smoothled;
 
-#ifndef SMOOTHLED_ASM_UPDATE
-#define SMOOTHLED_ASM_UPDATE 1
-#endif
-
 // Values in this table are inverted and the CCL LUT will flip them back.
 const uint16_t SmoothLed::Gamma25[Gamma25Size] =
 {
@@ -21,12 +17,60 @@ SmoothLed::SmoothLed(Interpolator* interpolators, uint16_t numInterpolators,
 {
     m_Interpolators = interpolators;
     m_NumInterpolators = numInterpolators;
-    m_Time = 0x8000;
+    setSegments(nullptr, 0);
+    m_AsyncBuffers[0] = m_AsyncBuffers[1] = nullptr;
+    m_AsyncBufferSize = 0;
+    m_Chunk.position = 0;
+    m_LatchMicros = 50;
+    setMapping(nullptr, 0, 1, nullptr);
     setGammaLut(gammaLut, gammaLutSize);
     setDitherMask(ditherMask);
-    uint8_t dither = 0;
-    for (uint16_t i = 0; i < numInterpolators; ++i, dither += 26)
-        interpolators[i].dither = dither;
+#if SMOOTHLED_IDLE_DETECT
+    m_Converged = false;
+#endif
+#if SMOOTHLED_POWER_SUM
+    m_OutputSum = 0;
+    m_ChannelMilliamps = 20;
+#if SMOOTHLED_BRIGHTNESS
+    m_PowerLimit = 0;
+    m_PowerScale = 0xffff;
+#endif
+#endif
+    seedDither(SEED_RAMP);
+}
+
+static uint8_t reverseBits(uint8_t x)
+{
+    x = (x >> 4) | (x << 4);
+    x = ((x >> 2) & 0x33) | ((x & 0x33) << 2);
+    return ((x >> 1) & 0x55) | ((x & 0x55) << 1);
+}
+void SmoothLed::seedDither(DitherSeed seed, uint8_t channelsPerLed)
+{
+    changed();
+    if (channelsPerLed == 0)
+        channelsPerLed = 1;
+    uint8_t colourStep = 256 / channelsPerLed;
+    uint8_t led = 0, colour = 0;
+    for (uint16_t i = 0; i < m_NumInterpolators; ++i)
+    {
+        uint8_t dither;
+        switch (seed)
+        {
+        case SEED_ORDERED:
+            dither = reverseBits(led) + colour * colourStep;
+            break;
+        default:
+            dither = i * 26;
+            break;
+        }
+        m_Interpolators[i].dither = dither;
+        if (++colour == channelsPerLed)
+        {
+            colour = 0;
+            ++led;
+        }
+    }
 }
 
 void SmoothLed::update()
@@ -48,85 +92,575 @@ void SmoothLed::updateUsart()
     update(USART0.TXDATAL, USART0.STATUS);
     endTransactionUsart();
 }
-void SmoothLed::beginFade(uint16_t numFrames)
+void SmoothLed::updateAndSetFadeTarget(uint16_t index, const uint8_t* target, uint16_t count, uint16_t fraction)
+{
+#if SMOOTHLED_ASM_UPDATE && SMOOTHLED_FUSED_TARGETS
+    if (!isSpi() && !m_Runs)
+    {
+#if SMOOTHLED_STATIC_CACHE
+        FadeTargets targets = { index, target, count, fraction, false };
+#else
+        FadeTargets targets = { index, target, count, fraction };
+#endif
+        beginTransactionUsart();
+        update(USART0.TXDATAL, USART0.STATUS, &targets);
+        endTransactionUsart();
+        changed();
+#if SMOOTHLED_STATIC_CACHE
+        // the kernel leaves the channels it stopped for us to cache
+        if (targets.stopped)
+            cacheStopped(index, count);
+#endif
+        return;
+    }
+#endif
+    update();
+    setFadeTarget(index, target, count, fraction);
+}
+bool SmoothLed::updateAsync(void (*callback)())
+{
+    if (!isSpi())
+    {
+        updateUsart();
+        if (callback)
+            callback();
+        return true;
+    }
+    // a mapping set after the buffers can need more than they hold
+    if (m_AsyncBufferSize < m_NumOutputs)
+        return false;
+    uint8_t* buffer = m_AsyncBuffers[0];
+    if (buffer == m_AsyncBuffers[1])
+        while (isBusy()) {}
+    update(buffer);
+    while (isBusy()) {}
+    writeAsync(buffer, m_NumOutputs, callback);
+    m_AsyncBuffers[0] = m_AsyncBuffers[1];
+    m_AsyncBuffers[1] = buffer;
+    return true;
+}
+void SmoothLed::Segment::beginFade(uint16_t numFrames)
 {
     m_Time = 0;
     m_DeltaTime = uint16_t(0x8000) / numFrames;
 }
+uint8_t SmoothLed::Segment::updateTime()
+{
+    uint8_t lastT = highByte(m_Time);
+    if (lastT >= 0x80)
+        return 0;
+    m_Time += m_DeltaTime;
+    uint8_t dt = highByte(m_Time) - lastT;
+#if SMOOTHLED_BRIGHTNESS
+    // cover the same fraction of the remaining distance as the fade clock
+    if (highByte(m_Time) >= 0x80)
+        m_Brightness = m_BrightnessTarget;
+    else if (dt)
+        m_Brightness += (int32_t(m_BrightnessTarget) - m_Brightness) * dt / (0x80 - lastT);
+#endif
+    return dt;
+}
+void SmoothLed::setSegments(Segment* segments, uint8_t numSegments)
+{
+    changed();
+    if (!segments || !numSegments)
+    {
+        segments = &m_Segment;
+        numSegments = 1;
+    }
+    m_Segments = segments;
+    m_NumSegments = numSegments;
+}
+uint16_t SmoothLed::getSegmentStart(uint8_t index) const
+{
+    uint16_t start = 0;
+    for (uint8_t s = 0; s < index; ++s)
+        start += m_Segments[s].getNumInterpolators();
+    return min(start, m_NumInterpolators);
+}
+uint16_t SmoothLed::getSegmentLength(uint8_t index) const
+{
+    return segmentLength(index, m_NumInterpolators - getSegmentStart(index));
+}
+void SmoothLed::beginFade(uint16_t numFrames)
+{
+    changed();
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+        m_Segments[s].beginFade(numFrames);
+}
 void SmoothLed::setFadePosition(uint16_t time)
 {
-    m_Time = time;
+    changed();
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+        m_Segments[s].setFadePosition(time);
 }
 void SmoothLed::setFadeRate(uint16_t speed)
 {
-    m_DeltaTime = speed;
+    changed();
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+        m_Segments[s].setFadeRate(speed);
+}
+#if SMOOTHLED_BRIGHTNESS
+void SmoothLed::setBrightness(uint16_t brightness)
+{
+    changed();
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+        m_Segments[s].setBrightness(brightness);
+}
+void SmoothLed::setBrightnessTarget(uint16_t brightness)
+{
+    changed();
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+        m_Segments[s].setBrightnessTarget(brightness);
+}
+#endif
+#if SMOOTHLED_POWER_SUM && SMOOTHLED_BRIGHTNESS
+// Q14 square root of a Q14 value
+static uint16_t sqrtQ14(uint16_t x)
+{
+    uint32_t n = uint32_t(x) << 14;
+    uint32_t root = 0;
+    for (uint32_t bit = uint32_t(1) << 30; bit; bit >>= 2)
+    {
+        if (n >= root + bit)
+        {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+            root >>= 1;
+    }
+    return root;
+}
+uint16_t SmoothLed::limitPower(uint16_t scale, uint32_t outputSum, uint32_t budget)
+{
+    // Q14 ratio of the budget to the last frame, up to 4
+    uint16_t ratio = 0xffff;
+    if (budget < outputSum * 4)
+    {
+        while (budget >= 0x40000)
+        {
+            budget >>= 1;
+            outputSum >>= 1;
+        }
+        ratio = (budget << 14) / outputSum;
+    }
+    // The output goes up with about brightness^gamma, so for gamma >= 2 the
+    // square root brings a frame over the budget back under it straight
+    // away and the fourth root creeps up to the budget without passing it.
+    uint16_t factor = sqrtQ14(ratio);
+    if (ratio > 1 << 14)
+        factor = sqrtQ14(factor);
+    uint32_t scaled = (uint32_t(scale) * factor >> 14) + 1;
+    return scaled > 0xffff ? 0xffff : scaled;
+}
+#endif
+bool SmoothLed::isFading() const
+{
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+        if (m_Segments[s].isFading())
+            return true;
+    return false;
 }
 uint8_t SmoothLed::updateTime()
 {
-    uint8_t lastT = highByte(m_Time);
-    if (lastT >= 0x80)
-        return 0;
-    m_Time += m_DeltaTime;
-    return highByte(m_Time) - lastT;
+    uint8_t dt = m_Segments[0].updateTime();
+    for (uint8_t s = 1; s < m_NumSegments; ++s)
+        m_Segments[s].updateTime();
+    return dt;
+}
+uint8_t SmoothLed::updateTime(uint8_t index, uint16_t first)
+{
+    Segment& segment = m_Segments[index];
+#if SMOOTHLED_STATIC_CACHE
+    bool fading = segment.isFading();
+    uint8_t dt = segment.updateTime();
+    if (!fading || segment.isFading())
+        return dt;
+    // the fade has ended, after this step its channels hold still
+    uint16_t count = segmentLength(index, m_NumInterpolators - first);
+    if (count)
+        cacheFinished(first, count, dt);
+    return 0;
+#else
+    (void) first;
+    return segment.updateTime();
+#endif
 }
 
-extern "C" void SmoothLedUpdate8cpb(
+extern "C" uint32_t SmoothLedUpdate8cpb(
     uint16_t count, SmoothLed::Interpolator * interpolators,
     register8_t& outport,
     uint8_t dt, uint16_t ditherMask, uint16_t maxValue,
-    const uint16_t * gammaLut, register8_t& statusport);
+    const void* gammaLut, register8_t& statusport, uint16_t dim);
+extern "C" uint32_t SmoothLedUpdateTargets8cpb(
+    uint8_t count, SmoothLed::Interpolator * interpolators,
+    const uint8_t* targets,
+    uint8_t dt, uint16_t ditherMask, uint16_t maxValue,
+    const void* gammaLut, uint16_t fraction, uint16_t dim);
 
-void SmoothLed::update(register8_t& data, register8_t& status)
+void SmoothLed::update(register8_t& data, register8_t& status, FadeTargets* targets)
 {
-    uint8_t dt = updateTime();
+#if !SMOOTHLED_ASM_UPDATE || !SMOOTHLED_FUSED_TARGETS
+    (void) targets;
+#endif
+    if (m_Runs)
+    {
+        updateMapped(nullptr);
+        return;
+    }
     Interpolator* i = getInterpolators();
-    uint16_t count = getNumInterpolators();
+    uint16_t remaining = getNumInterpolators();
     uint8_t ditherMask = getDitherMask();
     uint16_t maxvalue = getMaxValue();
-    const uint16_t* gammaLut = getGammaLut();
+    uint32_t sent = 0;
+    bool dithering = false;
 #if SMOOTHLED_ASM_UPDATE
-    // 8 cycle per bit loop for maximum throughput at 8MHz
-    SmoothLedUpdate8cpb(count, i, data, dt, ditherMask, maxvalue, gammaLut, status);
+    const uint16_t* gammaLuts[SMOOTHLED_GAMMA_CHANNELS];
 #else
-    do {
-        uint8_t value = i++->update(dt, gammaLut, maxvalue, ditherMask);
-        while ((status & USART_DREIF_bm) == 0) {}
-        data = value;
-    } while (--count);
+    uint8_t gammaChannel = 0;
+#endif
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+    {
+        uint8_t dt = updateTime(s, m_NumInterpolators - remaining);
+        uint16_t dim = getKernelDim(m_Segments[s]);
+        uint16_t count = segmentLength(s, remaining);
+        if (count == 0)
+            continue;
+        remaining -= count;
+#if SMOOTHLED_ASM_UPDATE
+        // 8 cycle per bit loop for maximum throughput at 8MHz
+        do {
+            uint16_t n = count < KernelSumChunk ? count : KernelSumChunk;
+            uint16_t index = i - m_Interpolators;
+            const void* gammaLut = getKernelGammaLuts(index, gammaLuts);
+            uint32_t result;
+#if SMOOTHLED_FUSED_TARGETS
+            // stop at the start and end of the channels taking fade targets
+            uint16_t offset = targets ? index - targets->index : 0;
+            if (targets && index < targets->index)
+                n = min(n, uint16_t(targets->index - index));
+            if (targets && index >= targets->index && offset < targets->count)
+            {
+                n = min(n, min(uint16_t(targets->count - offset), uint16_t(KernelTargetsChunk)));
+                result = SmoothLedUpdateTargets8cpb(n, i, targets->target + offset, dt, ditherMask, maxvalue,
+                    gammaLut, targets->fraction, dim);
+#if SMOOTHLED_STATIC_CACHE
+                targets->stopped |= result & KernelDithering;
+#endif
+            }
+            else
 #endif
+            {
+                result = SmoothLedUpdate8cpb(n, i, data, dt, ditherMask, maxvalue, gammaLut, status, dim);
+                dithering |= result & KernelDithering;
+            }
+            sent += result >> 16;
+            i += n;
+            count -= n;
+        } while (count);
+#else
+        do {
+            uint8_t dither = i->dither;
+            uint8_t value = i->update(dt, m_GammaLuts[gammaChannel], maxvalue, ditherMask, dim);
+            dithering |= i++->dither != dither;
+            nextGammaChannel(gammaChannel);
+            sent += value;
+            while ((status & USART_DREIF_bm) == 0) {}
+            data = value;
+        } while (--count);
+#endif
+    }
+    endFrame(sent, dithering);
 }
 
-extern "C" void SmoothLedUpdate(
+extern "C" uint32_t SmoothLedUpdate(
     uint16_t count, SmoothLed::Interpolator * interpolators,
     uint8_t* outputBuffer,
     uint8_t dt, uint16_t ditherMask, uint16_t maxValue,
-    const uint16_t * gammaLut);
+    const void* gammaLut, uint16_t dim);
 
 void SmoothLed::update(uint8_t* outputBuffer)
 {
-    uint8_t dt = updateTime();
+    if (m_Runs)
+    {
+        updateMapped(outputBuffer);
+        return;
+    }
     Interpolator* i = getInterpolators();
-    uint16_t count = getNumInterpolators();
+    uint16_t remaining = getNumInterpolators();
     uint8_t ditherMask = getDitherMask();
     uint16_t maxvalue = getMaxValue();
-    const uint16_t* gammaLut = getGammaLut();
+    uint32_t sent = 0;
+    bool dithering = false;
 #if SMOOTHLED_ASM_UPDATE
-    SmoothLedUpdate(count, i, outputBuffer, dt, ditherMask, maxvalue, gammaLut);
+    const uint16_t* gammaLuts[SMOOTHLED_GAMMA_CHANNELS];
 #else
+    uint8_t gammaChannel = 0;
+#endif
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+    {
+        uint8_t dt = updateTime(s, m_NumInterpolators - remaining);
+        uint16_t dim = getKernelDim(m_Segments[s]);
+        uint16_t count = segmentLength(s, remaining);
+        if (count == 0)
+            continue;
+#if SMOOTHLED_ASM_UPDATE
+        const void* gammaLut = getKernelGammaLuts(m_NumInterpolators - remaining, gammaLuts);
+#endif
+        remaining -= count;
+#if SMOOTHLED_ASM_UPDATE
+        do {
+            uint16_t n = count < KernelSumChunk ? count : KernelSumChunk;
+            uint32_t result = SmoothLedUpdate(n, i, outputBuffer, dt, ditherMask, maxvalue, gammaLut, dim);
+            sent += result >> 16;
+            dithering |= result & KernelDithering;
+            i += n;
+            outputBuffer += n;
+            count -= n;
+        } while (count);
+#else
+        do {
+            uint8_t dither = i->dither;
+            uint8_t value = i->update(dt, m_GammaLuts[gammaChannel], maxvalue, ditherMask, dim);
+            dithering |= i++->dither != dither;
+            nextGammaChannel(gammaChannel);
+            sent += value;
+            *outputBuffer++ = value;
+        } while (--count);
+#endif
+    }
+    endFrame(sent, dithering);
+}
+
+void SmoothLed::updateMapped(uint8_t* outputBuffer)
+{
+    // the logical frame, updateChannels adds up m_Chunk's totals
+    m_Chunk.sent = 0;
+    m_Chunk.dithering = false;
+    uint16_t index = 0;
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+    {
+        uint8_t dt = updateTime(s, index);
+        uint16_t count = segmentLength(s, m_NumInterpolators - index);
+        if (count)
+            updateChannels(index, count, dt, getKernelDim(m_Segments[s]), m_MapBuffer + index);
+        index += count;
+    }
+
+    // then the physical strip run by run, channels within an LED in order
+    register8_t& data = isSpi() ? SPI0.DATA : USART0.TXDATAL;
+    register8_t& status = isSpi() ? SPI0.INTFLAGS : USART0.STATUS;
+    uint32_t sent = 0;
+    for (const Run* run = m_Runs; run != m_Runs + m_NumRuns; ++run)
+    {
+        for (uint8_t r = run->repeat; r; --r)
+        {
+            for (uint16_t n = 0; n < run->count; ++n)
+            {
+                uint16_t logical = run->start + (run->reverse ? run->count - 1 - n : n);
+                const uint8_t* led = m_MapBuffer + logical * m_MapChannels;
+                for (uint8_t c = m_MapChannels; c; --c)
+                {
+                    uint8_t value = *led++;
+                    sent += value;
+                    if (outputBuffer)
+                        *outputBuffer++ = value;
+                    else
+                    {
+                        while ((status & USART_DREIF_bm) == 0) {}
+                        data = value;
+                    }
+                }
+            }
+        }
+    }
+    // endFrame counts unlit channels from getNumInterpolators()
+    endFrame(sent - (uint32_t(m_NumOutputs) - m_NumInterpolators) * 255, m_Chunk.dithering);
+}
+bool SmoothLed::setMapping(const Run* runs, uint8_t numRuns, uint8_t channelsPerLed, uint8_t* buffer)
+{
+    changed();
+    m_Runs = nullptr;
+    m_NumOutputs = m_NumInterpolators;
+    if (!runs || !buffer)
+        return true;
+    if (channelsPerLed == 0)
+        return false;
+    uint16_t numLeds = m_NumInterpolators / channelsPerLed;
+    uint32_t numOutputs = 0;
+    for (uint8_t r = 0; r < numRuns; ++r)
+    {
+        if (runs[r].start > numLeds || runs[r].count > numLeds - runs[r].start)
+            return false;
+        numOutputs += uint32_t(runs[r].count) * runs[r].repeat * channelsPerLed;
+    }
+    if (numOutputs > 0xffff)
+        return false;
+    m_Runs = runs;
+    m_NumRuns = numRuns;
+    m_MapChannels = channelsPerLed;
+    m_MapBuffer = buffer;
+    m_NumOutputs = numOutputs;
+    return true;
+}
+uint16_t SmoothLed::updateChunk(uint16_t maxChannels, uint8_t* outputBuffer)
+{
+    // a mapped frame is worked out whole before it's sent
+    if (m_Runs)
+    {
+        if (outputBuffer)
+            update(outputBuffer);
+        else
+            update();
+        return 0;
+    }
+    if (m_Chunk.position == 0)
+    {
+        if (!outputBuffer)
+        {
+            if (isSpi())
+                beginTransactionSpi();
+            else
+                beginTransactionUsart();
+        }
+        m_Chunk.segmentEnd = 0;
+        m_Chunk.segment = 0;
+        m_Chunk.sent = 0;
+        m_Chunk.dithering = false;
+    }
+    else if (!outputBuffer && micros() - m_Chunk.micros >= m_LatchMicros)
+    {
+        // the LEDs have shown the part sent so far, send it again with the
+        // fades where they are so the rest goes to the right LEDs
+        m_Chunk.sent = 0;
+        uint16_t start = 0;
+        for (uint8_t s = 0; start < m_Chunk.position; ++s)
+        {
+            uint16_t count = min(segmentLength(s, m_NumInterpolators - start), uint16_t(m_Chunk.position - start));
+            if (count)
+                updateChannels(start, count, 0, getKernelDim(m_Segments[s]), nullptr);
+            start += count;
+        }
+    }
+    while (maxChannels && m_Chunk.position < m_NumInterpolators)
+    {
+        if (m_Chunk.position == m_Chunk.segmentEnd)
+        {
+            m_Chunk.dt = updateTime(m_Chunk.segment, m_Chunk.segmentEnd);
+            m_Chunk.segmentEnd += segmentLength(m_Chunk.segment++, m_NumInterpolators - m_Chunk.segmentEnd);
+            continue;
+        }
+        uint16_t count = min(maxChannels, uint16_t(m_Chunk.segmentEnd - m_Chunk.position));
+        updateChannels(m_Chunk.position, count, m_Chunk.dt, getKernelDim(m_Segments[m_Chunk.segment - 1]),
+            outputBuffer ? outputBuffer + m_Chunk.position : nullptr);
+        m_Chunk.position += count;
+        maxChannels -= count;
+    }
+    uint16_t remaining = m_NumInterpolators - m_Chunk.position;
+    if (remaining)
+    {
+        m_Chunk.micros = micros();
+        return remaining;
+    }
+
+    // segments past the end of the strip still keep time
+    while (m_Chunk.segment < m_NumSegments)
+        updateTime(m_Chunk.segment++, m_NumInterpolators);
+    if (!outputBuffer)
+    {
+        if (isSpi())
+            endTransactionSpi();
+        else
+            endTransactionUsart();
+    }
+    m_Chunk.position = 0;
+    endFrame(m_Chunk.sent, m_Chunk.dithering);
+    return 0;
+}
+void SmoothLed::updateChannels(uint16_t index, uint16_t count, uint8_t dt, uint16_t dim, uint8_t* outputBuffer)
+{
+    Interpolator* i = m_Interpolators + index;
+    uint8_t ditherMask = getDitherMask();
+    uint16_t maxvalue = getMaxValue();
+    register8_t& data = isSpi() ? SPI0.DATA : USART0.TXDATAL;
+    register8_t& status = isSpi() ? SPI0.INTFLAGS : USART0.STATUS;
+#if SMOOTHLED_ASM_UPDATE
+    const uint16_t* gammaLuts[SMOOTHLED_GAMMA_CHANNELS];
+    do {
+        uint16_t n = count < KernelSumChunk ? count : KernelSumChunk;
+        const void* gammaLut = getKernelGammaLuts(i - m_Interpolators, gammaLuts);
+        uint32_t result;
+        if (outputBuffer)
+        {
+            result = SmoothLedUpdate(n, i, outputBuffer, dt, ditherMask, maxvalue, gammaLut, dim);
+            outputBuffer += n;
+        }
+        else
+            result = SmoothLedUpdate8cpb(n, i, data, dt, ditherMask, maxvalue, gammaLut, status, dim);
+        m_Chunk.sent += result >> 16;
+        m_Chunk.dithering |= result & KernelDithering;
+        i += n;
+        count -= n;
+    } while (count);
+#else
+    uint8_t gammaChannel = getGammaChannel(index);
     do {
-        *outputBuffer++ = i++->update(dt, gammaLut, maxvalue, ditherMask);
+        uint8_t dither = i->dither;
+        uint8_t value = i->update(dt, m_GammaLuts[gammaChannel], maxvalue, ditherMask, dim);
+        m_Chunk.dithering |= i++->dither != dither;
+        nextGammaChannel(gammaChannel);
+        m_Chunk.sent += value;
+        if (outputBuffer)
+            *outputBuffer++ = value;
+        else
+        {
+            while ((status & USART_DREIF_bm) == 0) {}
+            data = value;
+        }
     } while (--count);
 #endif
 }
 
-uint8_t SmoothLed::Interpolator::update(uint8_t dt, const uint16_t* lut, uint16_t maxvalue, uint8_t ditherMask)
+uint8_t SmoothLed::Interpolator::update(uint8_t dt, const uint16_t* lut, uint16_t maxvalue, uint8_t ditherMask, uint16_t dim)
+{
+    return applyDither(correct(dt, lut, maxvalue, dim), ditherMask);
+}
+uint16_t SmoothLed::Interpolator::correct(uint8_t dt, const uint16_t* lut, uint16_t maxvalue, uint16_t dim)
 {    
-    value = fmac(value, step, dt); //value += (step * dt) >> 7;
-    if (highByte(maxvalue) < highByte(value))
-        value = value < 0 ? 0 : maxvalue;
-    lut += highByte(value);
-    uint16_t corrected = lerp(lut[0], lut[1], lowByte(value)) + dither;
-    dither = lowByte(corrected) & ditherMask;
+    uint16_t corrected;
+#if SMOOTHLED_STATIC_CACHE
+    if (value & Cached)
+        corrected = step;
+    else
+#endif
+    {
+#if SMOOTHLED_COMPACT_INTERPOLATOR
+        value += (step * dt) * 2 >> (8 - SMOOTHLED_COMPACT_STEP_SHIFT);
+#else
+        value = fmac(value, step, dt); //value += (step * dt) >> 7;
+#endif
+        if (highByte(maxvalue) < highByte(value))
+            value = value < 0 ? 0 : maxvalue;
+        uint16_t dimmed = value;
+#if SMOOTHLED_BRIGHTNESS
+        // dimmed -= (dimmed * dim) >> 16 without the low byte product, as in the kernels
+        dimmed -= highByte(dimmed) * highByte(dim) +
+            highByte(highByte(dimmed) * lowByte(dim)) + highByte(lowByte(dimmed) * highByte(dim));
+#else
+        (void) dim;
+#endif
+        lut += highByte(dimmed);
+        corrected = lerp(lut[0], lut[1], lowByte(dimmed));
+    }
+    return corrected;
+}
+uint8_t SmoothLed::Interpolator::applyDither(uint16_t corrected, uint8_t ditherMask)
+{
+    // matches the asm kernels: the masked error is added to the previous dither
+    // state and the full low byte is kept so its lower bits act as a fixed offset
+    corrected = (corrected & (0xff00 | ditherMask)) + dither;
+    dither = lowByte(corrected);
     return highByte(corrected);
 }
 void SmoothLed::Interpolator::setFadeTarget(uint8_t target, uint8_t range)
@@ -141,17 +675,33 @@ uint16_t SmoothLed::expandRange(uint8_t value) const
 {
     return expandRange(value, m_GammaLutSize);
 }
+uint16_t SmoothLed::gammaCorrect(uint16_t value, uint8_t gammaChannel) const
+{
+    const uint16_t* lut = m_GammaLuts[gammaChannel] + highByte(value);
+    return lerp(lut[0], lut[1], lowByte(value));
+}
 void SmoothLed::setFadeTarget(uint16_t index, uint8_t target)
 {
-    m_Interpolators[index].setFadeTarget(target, m_GammaLutSize);
+    changed();
+    Interpolator& i = m_Interpolators[index];
+    i.setFadeTarget(target, m_GammaLutSize);
+    if (SMOOTHLED_STATIC_CACHE && i.step == 0)
+        cacheStatic(i, getGammaChannel(index));
 }
 void SmoothLed::setFadeTarget(uint16_t index, uint8_t target, uint16_t fraction)
 {
-    m_Interpolators[index].setFadeTarget(target, m_GammaLutSize, fraction);
+    changed();
+    Interpolator& i = m_Interpolators[index];
+    i.setFadeTarget(target, m_GammaLutSize, fraction);
+    if (SMOOTHLED_STATIC_CACHE && i.step == 0)
+        cacheStatic(i, getGammaChannel(index));
 }
 void SmoothLed::set(uint16_t index, uint8_t value)
 {
-    m_Interpolators[index].set(expandRange(value));
+    changed();
+    Interpolator& i = m_Interpolators[index];
+    i.set(expandRange(value));
+    cacheStatic(i, getGammaChannel(index));
 }
 void SmoothLed::clear(uint8_t value)
 {
@@ -159,45 +709,155 @@ void SmoothLed::clear(uint8_t value)
 }
 void SmoothLed::clear(uint16_t index, uint16_t count, uint8_t value)
 {
+    changed();
     Interpolator* i = &m_Interpolators[index];
     uint16_t fullvalue = expandRange(value);
+#if SMOOTHLED_STATIC_CACHE
+    uint16_t corrected[SMOOTHLED_GAMMA_CHANNELS];
+    for (uint8_t n = 0; n < SMOOTHLED_GAMMA_CHANNELS; ++n)
+        corrected[n] = gammaCorrect(fullvalue, n);
+    uint8_t gammaChannel = getGammaChannel(index);
+    do {
+        i->set(fullvalue);
+        i++->hold(corrected[gammaChannel]);
+        nextGammaChannel(gammaChannel);
+    } while (--count);
+#else
     do {
         i++->set(fullvalue);
     } while (--count);
+#endif
 }
+#if SMOOTHLED_ASM_UPDATE
+// bulk versions of Interpolator::set and setFadeTarget in SmoothLedUpdate.S
+extern "C" void SmoothLedSet(
+    uint16_t count, SmoothLed::Interpolator * interpolators,
+    const uint8_t* values, uint8_t range);
+extern "C" uint8_t SmoothLedSetFadeTargets(
+    uint16_t count, SmoothLed::Interpolator * interpolators,
+    const uint8_t* targets, uint8_t range, uint16_t fraction);
+#endif
+
 void SmoothLed::set(uint16_t index, const uint8_t* values, uint16_t count)
 {
+    changed();
     Interpolator* i = &m_Interpolators[index];
     uint8_t range = m_GammaLutSize;
+#if SMOOTHLED_ASM_UPDATE && !SMOOTHLED_STATIC_CACHE
+    SmoothLedSet(count, i, values, range);
+#else
+    uint8_t gammaChannel = getGammaChannel(index);
     do {
-        i++->set(*values++, range);
+        i->set(*values++, range);
+        cacheStatic(*i++, gammaChannel);
+        nextGammaChannel(gammaChannel);
     } while (--count);
+#endif
 }
 void SmoothLed::setFadeTarget(uint16_t index, const uint8_t* target, uint16_t count)
 {
+#if SMOOTHLED_ASM_UPDATE
+    // a fraction of 1.0 gives the same steps
+    setFadeTarget(index, target, count, 0x8000);
+#else
+    changed();
     Interpolator* i = &m_Interpolators[index];
     uint8_t range = m_GammaLutSize;
+    uint8_t gammaChannel = getGammaChannel(index);
     do {
-        i++->setFadeTarget(*target++, range);
+        i->setFadeTarget(*target++, range);
+        if (SMOOTHLED_STATIC_CACHE && i->step == 0)
+            cacheStatic(*i, gammaChannel);
+        ++i;
+        nextGammaChannel(gammaChannel);
     } while (--count);
+#endif
 }
 void SmoothLed::setFadeTarget(uint16_t index, const uint8_t* target, uint16_t count, uint16_t fraction)
 {
+    changed();
     Interpolator* i = &m_Interpolators[index];
     uint8_t range = m_GammaLutSize;
+#if SMOOTHLED_ASM_UPDATE && SMOOTHLED_STATIC_CACHE
+    // the kernel leaves the channels it stopped for us to cache
+    if (SmoothLedSetFadeTargets(count, i, target, range, fraction))
+        cacheStopped(index, count);
+#elif SMOOTHLED_ASM_UPDATE
+    SmoothLedSetFadeTargets(count, i, target, range, fraction);
+#else
+    uint8_t gammaChannel = getGammaChannel(index);
     do {
-        i++->setFadeTarget(*target++, range, fraction);
+        i->setFadeTarget(*target++, range, fraction);
+        if (SMOOTHLED_STATIC_CACHE && i->step == 0)
+            cacheStatic(*i, gammaChannel);
+        ++i;
+        nextGammaChannel(gammaChannel);
     } while (--count);
+#endif
 }
 void SmoothLed::clearFadeTarget(uint16_t index, uint16_t count)
 {
+    changed();
     Interpolator* i = &m_Interpolators[index];
+    uint8_t gammaChannel = getGammaChannel(index);
     do {
-        i++->stop();
+        i->stop();
+        cacheStatic(*i++, gammaChannel);
+        nextGammaChannel(gammaChannel);
     } while (--count);
 }
+#if SMOOTHLED_STATIC_CACHE
+void SmoothLed::updateStaticCache()
+{
+    Interpolator* i = m_Interpolators;
+    uint8_t gammaChannel = 0;
+    for (uint16_t count = m_NumInterpolators; count > 0; --count, ++i)
+    {
+        if (i->value & Interpolator::Cached)
+            cacheStatic(*i, gammaChannel);
+        nextGammaChannel(gammaChannel);
+    }
+}
+void SmoothLed::cacheStopped(uint16_t index, uint16_t count)
+{
+    Interpolator* i = &m_Interpolators[index];
+    uint8_t gammaChannel = getGammaChannel(index);
+    do {
+        if (i->step == 0)
+            cacheStatic(*i, gammaChannel);
+        ++i;
+        nextGammaChannel(gammaChannel);
+    } while (--count);
+}
+void SmoothLed::cacheFinished(uint16_t index, uint16_t count, uint8_t dt)
+{
+    Interpolator* i = &m_Interpolators[index];
+    uint8_t gammaChannel = getGammaChannel(index);
+    uint16_t maxvalue = getMaxValue();
+    do {
+        // the same last step the update kernels would have taken
+        if (!(i->value & Interpolator::Cached))
+            i->hold(i->correct(dt, m_GammaLuts[gammaChannel], maxvalue));
+        ++i;
+        nextGammaChannel(gammaChannel);
+    } while (--count);
+}
+#endif
 
 void SmoothLed::Interpolator::setFadeTarget(uint16_t target, uint16_t fraction)
 {
+#if SMOOTHLED_STATIC_CACHE
+    value &= ~Cached;
+#endif
+#if SMOOTHLED_COMPACT_INTERPOLATOR
+    int16_t delta = target - value;
+    step = compactStep(fmul(delta, fraction));
+    // a small fraction of a short distance rounds to 0 and the fade would
+    // stall, so take at least a unit towards a target half a unit or more
+    // away (closer than that is the rounded end point)
+    if (step == 0 && compactStep(delta))
+        step = delta > 0 ? 1 : -1;
+#else
     step = fmul(target - value, fraction);
+#endif
 }
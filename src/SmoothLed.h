@@ -4,15 +4,24 @@
 #pragma once
 
 #include "SmoothLedCcl.h"
+#include "SmoothLedConfig.h"
+
+namespace smoothled { template<uint8_t Size> struct GammaTable; } // SmoothLedGamma.h
 
 class SmoothLed : public SmoothLedCcl
 {
+    friend class SmoothLedMulti;
+    friend class SmoothLedApa102;
+
 public:
     struct Interpolator;
+    class Segment;
 
     enum DitherBits { DITHER0 = 0,
         DITHER1 = 0x80, DITHER2 = 0xC0, DITHER3 = 0xE0, DITHER4 = 0xF0,
         DITHER5 = 0xF8, DITHER6 = 0xFC, DITHER7 = 0xFE, DITHER8 = 0xFF };
+    // Starting dither states, see seedDither
+    enum DitherSeed { SEED_RAMP, SEED_ORDERED };
     static const uint8_t Gamma25Size = 32;
     static const uint16_t Gamma25[Gamma25Size];
 
@@ -25,17 +34,130 @@ public:
     void updateSpi();
     void updateUsart();
 
+    // Interrupt driven update using SPI (see SmoothLedCcl::writeAsync).  The
+    // next frame is calculated into one buffer while the previous one is
+    // sent from the other, then this returns as soon as the new frame has
+    // started sending.  size is the bytes each buffer holds, which must be
+    // at least getNumOutputs() (getNumInterpolators() without a mapping);
+    // with a single buffer (buffer1 nullptr) the previous frame has to
+    // finish before calculating the next one.  Returns false, doing
+    // nothing, if no buffer is set or it is too small.  In USART mode this
+    // just calls updateUsart.
+    void setAsyncBuffers(uint8_t* buffer0, uint8_t* buffer1, uint16_t size);
+    bool updateAsync(void (*callback)() = nullptr);
+
+    // Resumable update for sharing the CPU with time critical work.  Each
+    // call sends up to maxChannels more channels of the frame to the LEDs
+    // (or writes them to outputBuffer[channel index]) and returns how many
+    // are left; after it returns 0 the next call starts a new frame.  Each
+    // segment's fade clock moves on when the frame reaches it, as in
+    // update.  Between calls the data line is held low, which the LEDs take
+    // as the end of the frame after getLatchMicros: a call that comes later
+    // than that first sends the part they have just shown again (without
+    // moving its fades on) so the frame still arrives whole.  Don't call
+    // update or change the segments in the middle of a frame.
+    uint16_t updateChunk(uint16_t maxChannels, uint8_t* outputBuffer = nullptr);
+    // Shortest time low that the LEDs may take as the end of a frame: 50us
+    // by default (WS2812 datasheet), 80 for SK6812, 280 for WS2812B-V5.
+    // Some WS2812B latch after as little as 6us.
+    void setLatchMicros(uint16_t latchMicros);
+    uint16_t getLatchMicros() const;
+
+    // update then setFadeTarget(index, target, count, fraction), for fading
+    // on to the next colours as soon as a frame is out.  With
+    // SMOOTHLED_FUSED_TARGETS the USART update works out each channel's
+    // fade step while that channel is being sent, so the pair takes no
+    // longer than the update (16MHz and above with the default timing).
+    void updateAndSetFadeTarget(uint16_t index, const uint8_t* target, uint16_t count, uint16_t fraction = 0x8000);
+
     void set(uint16_t index, uint8_t value);
     void set(uint16_t index, const uint8_t* values, uint16_t count);
     void clear(uint8_t value = 0);
     void clear(uint16_t index, uint16_t count, uint8_t value = 0);
 
+    // These apply to every segment; getFadePosition/getFadeRate return the
+    // first segment's and isFading is true while any segment is fading.
     void beginFade(uint16_t numFrames);
     void setFadeRate(uint16_t speed);
     void setFadePosition(uint16_t speed);
     uint16_t getFadePosition() const;
     uint16_t getFadeRate() const;
     bool isFading() const;
+#if SMOOTHLED_IDLE_DETECT
+    // True once an update has sent a frame that the following updates would
+    // only repeat: nothing is fading and no channel has dithering left to
+    // do.  Updates can then be skipped (and the CPU put to sleep) until the
+    // LEDs are changed through SmoothLed, which clears it.  Call wake after
+    // changing interpolators or segments directly.
+    bool isConverged() const;
+    void wake();
+#endif
+#if SMOOTHLED_BRIGHTNESS
+    // Master brightness of every segment, 0xffff = full (see Segment)
+    void setBrightness(uint16_t brightness);
+    void setBrightnessTarget(uint16_t brightness);
+    uint16_t getBrightness() const; // the first segment's
+#endif
+
+#if SMOOTHLED_POWER_SUM
+    // Sum of the channel levels sent by the last update (255 for a channel
+    // that is fully on) and the current that works out to at
+    // getChannelMilliamps for each fully lit channel.
+    uint32_t getOutputSum() const;
+    uint16_t getMilliamps() const;
+    void setChannelMilliamps(uint8_t milliamps); // 20 by default
+    uint8_t getChannelMilliamps() const;
+    static uint16_t milliamps(uint32_t outputSum, uint8_t channelMilliamps);
+#if SMOOTHLED_BRIGHTNESS
+    // Scale the brightness of the following frames so getMilliamps stays
+    // under milliamps, 0 (or a channel current of 0) for no limit.  The
+    // scale is worked out from the previous frame, so a sudden jump in
+    // colour can go over for a frame.
+    void setPowerLimit(uint16_t milliamps);
+    uint16_t getPowerLimit() const;
+    // applied on top of every segment's brightness, 0xffff when not limiting
+    void setPowerScale(uint16_t scale);
+    uint16_t getPowerScale() const;
+    // next power scale after a frame of outputSum with a budget in output levels
+    static uint16_t limitPower(uint16_t scale, uint32_t outputSum, uint32_t budget);
+#endif
+#endif
+
+    // Part of the physical strip showing consecutive logical LEDs, see setMapping
+    struct Run
+    {
+        uint16_t start;  // first logical LED
+        uint16_t count;  // LEDs, from start up or, reversed, from start + count - 1 down
+        uint8_t repeat;  // times in a row the run is sent
+        bool reverse;
+    };
+    // Drive more LEDs than there are interpolators.  The interpolators are
+    // taken as logical LEDs of channelsPerLed channels, and runs lists in
+    // the order the physical strip is wired which of them it shows: mirrored
+    // halves are { 0, n, 1, false }, { 0, n, 1, true }, a serpentine matrix
+    // alternates forward and reversed rows and a repeat count duplicates a
+    // fixture.  Each frame is calculated once into buffer (one byte per
+    // interpolator) and then sent run by run, so all copies of an LED show
+    // the same byte; the calculation no longer overlaps the sending, so a
+    // mapped frame takes longer than the same number of plain channels.  update(outputBuffer) and updateAsync then need
+    // getNumOutputs() bytes.  updateChunk sends a mapped frame in one go and
+    // SmoothLedMulti updates the strips one after the other, SmoothLedApa102
+    // doesn't take a mapping (its update returns false).  Pass nullptr to go back to one LED per
+    // interpolator.  Returns
+    // false, leaving the mapping off, if a run goes past the last whole
+    // logical LED, channelsPerLed is 0 or the strip would be over 65535
+    // channels.
+    bool setMapping(const Run* runs, uint8_t numRuns, uint8_t channelsPerLed, uint8_t* buffer);
+    uint16_t getNumOutputs() const; // channels of the physical strip
+
+    // Split the strip into consecutive ranges of channels that each have
+    // their own fade clock (see Segment).  The array must stay valid while
+    // in use; pass nullptr to go back to a single fade for the whole strip.
+    void setSegments(Segment* segments, uint8_t numSegments);
+    Segment& getSegment(uint8_t index);
+    uint8_t getNumSegments() const;
+    uint16_t getSegmentStart(uint8_t index) const; // index of the segment's first channel
+    uint16_t getSegmentLength(uint8_t index) const;
 
     void setFadeTarget(uint16_t index, uint8_t target);
     void setFadeTarget(uint16_t index, uint8_t target, uint16_t fraction); // Q1.15 fraction (0x8000 = 1.0)
@@ -44,60 +166,243 @@ public:
     void clearFadeTarget();
     void clearFadeTarget(uint16_t index, uint16_t count);
 
-    void setGammaLut(const uint16_t* gammaLut, uint8_t numEntries);
+    void setGammaLut(const uint16_t* gammaLut, uint8_t numEntries); // same table for every channel
+    template<uint8_t Size> void setGammaLut(const smoothled::GammaTable<Size>& gammaLut);
+    // SMOOTHLED_GAMMA_CHANNELS tables of numEntries entries, channel n uses
+    // gammaLuts[n % SMOOTHLED_GAMMA_CHANNELS]
+    void setGammaLuts(const uint16_t* const* gammaLuts, uint8_t numEntries);
     void setDitherMask(DitherBits ditherMask);
+    // Each channel's dither error keeps its offset from its neighbours' for
+    // as long as they hold the same level, so the starting states decide
+    // whether nearby LEDs step up together (visible as flicker or a pattern
+    // crawling along the strip) or take turns.  SEED_RAMP is the
+    // constructor's 26 * index.  SEED_ORDERED gives LED n the bit reversed
+    // n (a 1D Bayer pattern, so any 2^k neighbours are spread evenly) and
+    // rotates the colours of an LED a 1/channelsPerLed turn apart.
+    void seedDither(DitherSeed seed, uint8_t channelsPerLed = 3);
 
-    uint8_t         updateTime();
+    uint8_t         updateTime(); // advances every segment, returns the first one's time step
 
     Interpolator*   getInterpolators();
     Interpolator&   getInterpolator(uint16_t index);
     uint16_t        getNumInterpolators() const;
-    const uint16_t* getGammaLut() const;
+    const uint16_t* getGammaLut(uint8_t gammaChannel = 0) const;
+    // gammaLut argument of the assembly kernels for a run of channels from
+    // index: the table itself, or with SMOOTHLED_GAMMA_CHANNELS > 1 buffer
+    // (of that many pointers) filled with the tables in channel order
+    const void*     getKernelGammaLuts(uint16_t index, const uint16_t** buffer) const;
+    static uint8_t  getGammaChannel(uint16_t index);
+    uint16_t        getKernelDim(const Segment& segment) const; // dim argument of the kernels
+    // SMOOTHLED_POWER_SUM: most channels per kernel call, keeping the gamma
+    // tables in step and the 16 bit sum from overflowing
+    static const uint16_t KernelSumChunk = SMOOTHLED_POWER_SUM ?
+        256 / SMOOTHLED_GAMMA_CHANNELS * SMOOTHLED_GAMMA_CHANNELS : 0xffff;
+    // kernel results: the SMOOTHLED_POWER_SUM sum in the high word and
+    // SMOOTHLED_IDLE_DETECT flags in the low byte
+    static const uint8_t KernelDithering = 0x01;
+    // channels per SmoothLedUpdateTargets8cpb call: 8 bit count, whole
+    // rounds of the gamma tables and a 16 bit SMOOTHLED_POWER_SUM sum
+    static const uint8_t KernelTargetsChunk = 252;
     uint8_t         getRange() const;
     uint8_t         getDitherMask() const;
     uint16_t        getMaxValue() const;
 
     uint16_t        expandRange(uint8_t value) const; // convert 8 bit colour to 16 bits
     static uint16_t expandRange(uint8_t value, uint8_t range);
+    uint16_t        gammaCorrect(uint16_t value, uint8_t gammaChannel = 0) const; // 16 bit value to (inverted) output value
 
     struct Interpolator
     {
+#if SMOOTHLED_COMPACT_INTERPOLATOR
+        int8_t  step; // units of 1 << SMOOTHLED_COMPACT_STEP_SHIFT
+#else
         int16_t step;
+#endif
         int16_t value;
         uint8_t dither;
 
         void set(uint8_t value, uint8_t range);
         void set(uint16_t value);
+        uint16_t getValue() const;
 
         void setFadeTarget(uint16_t target);
         void setFadeTarget(uint16_t target, uint16_t fraction);
         void setFadeTarget(uint8_t target, uint8_t range);
         void setFadeTarget(uint8_t target, uint8_t range, uint16_t fraction);
         void stop();
+#if SMOOTHLED_STATIC_CACHE
+        static const uint16_t Cached = 0x8000;
+        void hold(uint16_t corrected); // stop and cache the gamma corrected value
+#endif
+#if SMOOTHLED_COMPACT_INTERPOLATOR
+        static int8_t compactStep(int16_t delta);
+#endif
 
-        uint8_t update(uint8_t dt, const uint16_t* gammaLut, uint16_t maxValue, uint8_t ditherMask);
+        // dim: SMOOTHLED_BRIGHTNESS attenuation, see Segment::getDim
+        uint8_t update(uint8_t dt, const uint16_t* gammaLut, uint16_t maxValue, uint8_t ditherMask, uint16_t dim = 0);
+        // the two halves of update: advance the fade and return the gamma
+        // corrected value, then dither a corrected value down to 8 bits
+        uint16_t correct(uint8_t dt, const uint16_t* gammaLut, uint16_t maxValue, uint16_t dim = 0);
+        uint8_t  applyDither(uint16_t corrected, uint8_t ditherMask);
+    };
+
+    // Fade clock for a range of channels.  Segments are updated in order in
+    // the same pass so the strip is still sent in a single transaction; the
+    // last segment always extends to the end of the strip.
+    class Segment
+    {
+    public:
+        Segment(uint16_t numInterpolators = 0);
+
+        void beginFade(uint16_t numFrames);
+        void setFadeRate(uint16_t speed);
+        void setFadePosition(uint16_t time);
+        uint16_t getFadePosition() const;
+        uint16_t getFadeRate() const;
+        bool isFading() const;
+        uint8_t updateTime();
+
+        void setNumInterpolators(uint16_t numInterpolators);
+        uint16_t getNumInterpolators() const;
+
+#if SMOOTHLED_BRIGHTNESS
+        // Brightness is applied to the 16 bit channel values before gamma
+        // correction, 0xffff = full.  setBrightness changes it straight
+        // away, setBrightnessTarget moves it with the fade clock so it
+        // arrives at the end of the current (or next) fade.
+        void setBrightness(uint16_t brightness);
+        void setBrightnessTarget(uint16_t brightness);
+        uint16_t getBrightness() const;
+        uint16_t getBrightnessTarget() const;
+#endif
+        uint16_t getDim() const; // kernel attenuation, 0xffff - brightness
+
+    private:
+        uint16_t m_NumInterpolators;
+        uint16_t m_Time;
+        uint16_t m_DeltaTime;
+#if SMOOTHLED_BRIGHTNESS
+        uint16_t m_Brightness;
+        uint16_t m_BrightnessTarget;
+#endif
     };
 
 private:
-    void update(register8_t& data, register8_t& status);
+    // fade targets for the USART update to set as it goes
+    struct FadeTargets
+    {
+        uint16_t index;
+        const uint8_t* target;
+        uint16_t count;
+        uint16_t fraction;
+#if SMOOTHLED_STATIC_CACHE
+        bool stopped; // some steps came out 0
+#endif
+    };
+
+    // progress of the frame updateChunk is sending
+    struct Chunk
+    {
+        uint16_t position;   // channels done, 0 between frames
+        uint16_t segmentEnd; // end of the segment being sent
+        uint8_t segment;     // next segment to start
+        uint8_t dt;          // time step of the segment being sent
+        unsigned long micros; // when the last call returned
+        uint32_t sent;
+        bool dithering;
+    };
+
+    void update(register8_t& data, register8_t& status, FadeTargets* targets = nullptr);
+    // count channels from index, all in one segment, to the LEDs or outputBuffer
+    void updateChannels(uint16_t index, uint16_t count, uint8_t dt, uint16_t dim, uint8_t* outputBuffer);
+    void updateMapped(uint8_t* outputBuffer);
+    void cacheStatic(Interpolator& i, uint8_t gammaChannel) const;
+    static void nextGammaChannel(uint8_t& gammaChannel);
+    uint16_t segmentLength(uint8_t index, uint16_t remaining) const;
+    // advance segment index, which starts at channel first, and return its
+    // time step.  SMOOTHLED_STATIC_CACHE: on the frame its fade ends the
+    // channels are moved to their end values and cached here instead, and
+    // the time step is 0.
+    uint8_t updateTime(uint8_t index, uint16_t first);
+    void endFrame(uint32_t sent, bool changing);
+    void changed();
+#if SMOOTHLED_STATIC_CACHE
+    void updateStaticCache();
+    void cacheStopped(uint16_t index, uint16_t count);
+    void cacheFinished(uint16_t index, uint16_t count, uint8_t dt);
+#endif
 
     Interpolator*   m_Interpolators;
-    const uint16_t* m_GammaLut;
+    const uint16_t* m_GammaLuts[SMOOTHLED_GAMMA_CHANNELS];
     uint16_t        m_NumInterpolators;
-    uint16_t        m_Time;
-    uint16_t        m_DeltaTime;
+    Segment*        m_Segments;
+    Segment         m_Segment;
+    uint8_t         m_NumSegments;
     uint8_t         m_GammaLutSize;
     uint8_t         m_DitherMask;
+    uint8_t*        m_AsyncBuffers[2];
+    uint16_t        m_AsyncBufferSize;
+    Chunk           m_Chunk;
+    uint16_t        m_LatchMicros;
+    const Run*      m_Runs;
+    uint8_t         m_NumRuns;
+    uint8_t         m_MapChannels;
+    uint8_t*        m_MapBuffer;
+    uint16_t        m_NumOutputs;
+#if SMOOTHLED_IDLE_DETECT
+    bool            m_Converged;
+#endif
+#if SMOOTHLED_POWER_SUM
+    uint32_t        m_OutputSum;
+    uint8_t         m_ChannelMilliamps;
+#if SMOOTHLED_BRIGHTNESS
+    uint16_t        m_PowerLimit;
+    uint16_t        m_PowerScale;
+#endif
+#endif
 };
 
 inline void SmoothLed::Interpolator::setFadeTarget(uint16_t target)
 {
+#if SMOOTHLED_STATIC_CACHE
+    value &= ~Cached;
+#endif
+#if SMOOTHLED_COMPACT_INTERPOLATOR
+    step = compactStep(target - value);
+#else
     step = target - value;
+#endif
+}
+#if SMOOTHLED_COMPACT_INTERPOLATOR
+inline int8_t SmoothLed::Interpolator::compactStep(int16_t delta)
+{
+    // round to the nearest step unit
+    delta = (delta + (1 << (SMOOTHLED_COMPACT_STEP_SHIFT - 1))) >> SMOOTHLED_COMPACT_STEP_SHIFT;
+    return delta > 127 ? 127 : delta < -128 ? -128 : delta;
 }
+#endif
 inline void SmoothLed::Interpolator::stop()
 {
+#if SMOOTHLED_STATIC_CACHE
+    value &= ~Cached;
+#endif
     step = 0; 
 }
+inline uint16_t SmoothLed::Interpolator::getValue() const
+{
+#if SMOOTHLED_STATIC_CACHE
+    return value & ~Cached;
+#else
+    return value;
+#endif
+}
+#if SMOOTHLED_STATIC_CACHE
+inline void SmoothLed::Interpolator::hold(uint16_t corrected)
+{
+    value |= Cached;
+    step = corrected;
+}
+#endif
 inline SmoothLed::Interpolator& SmoothLed::getInterpolator(uint16_t index)
 {
     return m_Interpolators[index];
@@ -112,12 +417,51 @@ inline uint16_t SmoothLed::getNumInterpolators() const
 }
 inline void SmoothLed::setGammaLut(const uint16_t* gammaLut, uint8_t numEntries)
 {
-    m_GammaLut = gammaLut;
+    const uint16_t* gammaLuts[SMOOTHLED_GAMMA_CHANNELS];
+    for (uint8_t n = 0; n < SMOOTHLED_GAMMA_CHANNELS; ++n)
+        gammaLuts[n] = gammaLut;
+    setGammaLuts(gammaLuts, numEntries);
+}
+inline void SmoothLed::setGammaLuts(const uint16_t* const* gammaLuts, uint8_t numEntries)
+{
+    changed();
+    for (uint8_t n = 0; n < SMOOTHLED_GAMMA_CHANNELS; ++n)
+        m_GammaLuts[n] = gammaLuts[n];
     m_GammaLutSize = numEntries - 1;
+#if SMOOTHLED_STATIC_CACHE
+    updateStaticCache();
+#endif
+}
+template<uint8_t Size>
+inline void SmoothLed::setGammaLut(const smoothled::GammaTable<Size>& gammaLut)
+{
+    setGammaLut(gammaLut.entries, Size);
+}
+inline const uint16_t* SmoothLed::getGammaLut(uint8_t gammaChannel) const
+{
+    return m_GammaLuts[gammaChannel];
+}
+inline const void* SmoothLed::getKernelGammaLuts(uint16_t index, const uint16_t** buffer) const
+{
+#if SMOOTHLED_GAMMA_CHANNELS > 1
+    uint8_t gammaChannel = getGammaChannel(index);
+    for (uint8_t n = 0; n < SMOOTHLED_GAMMA_CHANNELS; ++n, nextGammaChannel(gammaChannel))
+        buffer[n] = m_GammaLuts[gammaChannel];
+    return buffer;
+#else
+    (void) index;
+    (void) buffer;
+    return m_GammaLuts[0];
+#endif
 }
-inline const uint16_t* SmoothLed::getGammaLut() const
+inline uint8_t SmoothLed::getGammaChannel(uint16_t index)
 {
-    return m_GammaLut;
+    return index % SMOOTHLED_GAMMA_CHANNELS;
+}
+inline void SmoothLed::nextGammaChannel(uint8_t& gammaChannel)
+{
+    if (++gammaChannel == SMOOTHLED_GAMMA_CHANNELS)
+        gammaChannel = 0;
 }
 inline uint8_t SmoothLed::getRange() const
 {
@@ -125,6 +469,7 @@ inline uint8_t SmoothLed::getRange() const
 }
 inline void SmoothLed::setDitherMask(DitherBits ditherMask)
 {
+    changed();
     m_DitherMask = ditherMask;
 }
 inline uint8_t SmoothLed::getDitherMask() const
@@ -150,19 +495,215 @@ inline void SmoothLed::Interpolator::set(uint16_t newvalue)
     value = newvalue;
     step = 0;
 }
-inline bool SmoothLed::isFading() const
+inline SmoothLed::Segment::Segment(uint16_t numInterpolators)
+{
+    m_NumInterpolators = numInterpolators;
+    m_Time = 0x8000;
+    m_DeltaTime = 0;
+#if SMOOTHLED_BRIGHTNESS
+    m_Brightness = m_BrightnessTarget = 0xffff;
+#endif
+}
+inline void SmoothLed::Segment::setFadePosition(uint16_t time)
+{
+    m_Time = time;
+}
+inline void SmoothLed::Segment::setFadeRate(uint16_t speed)
+{
+    m_DeltaTime = speed;
+}
+inline bool SmoothLed::Segment::isFading() const
 {
     return highByte(m_Time) < 0x80;
 }
-inline uint16_t SmoothLed::getFadePosition() const
+inline uint16_t SmoothLed::Segment::getFadePosition() const
 {
     return m_Time;
 }
-inline uint16_t SmoothLed::getFadeRate() const
+inline uint16_t SmoothLed::Segment::getFadeRate() const
 {
     return m_DeltaTime;
 }
+inline void SmoothLed::Segment::setNumInterpolators(uint16_t numInterpolators)
+{
+    m_NumInterpolators = numInterpolators;
+}
+inline uint16_t SmoothLed::Segment::getNumInterpolators() const
+{
+    return m_NumInterpolators;
+}
+#if SMOOTHLED_BRIGHTNESS
+inline void SmoothLed::Segment::setBrightness(uint16_t brightness)
+{
+    m_Brightness = m_BrightnessTarget = brightness;
+}
+inline void SmoothLed::Segment::setBrightnessTarget(uint16_t brightness)
+{
+    m_BrightnessTarget = brightness;
+}
+inline uint16_t SmoothLed::Segment::getBrightness() const
+{
+    return m_Brightness;
+}
+inline uint16_t SmoothLed::Segment::getBrightnessTarget() const
+{
+    return m_BrightnessTarget;
+}
+inline uint16_t SmoothLed::getBrightness() const
+{
+    return m_Segments[0].getBrightness();
+}
+#endif
+inline uint16_t SmoothLed::Segment::getDim() const
+{
+#if SMOOTHLED_BRIGHTNESS
+    return ~m_Brightness;
+#else
+    return 0;
+#endif
+}
+inline uint16_t SmoothLed::getKernelDim(const Segment& segment) const
+{
+#if SMOOTHLED_POWER_SUM && SMOOTHLED_BRIGHTNESS
+    return ~uint16_t(segment.getBrightness() * (m_PowerScale + 1UL) >> 16);
+#else
+    return segment.getDim();
+#endif
+}
+#if SMOOTHLED_POWER_SUM
+inline uint32_t SmoothLed::getOutputSum() const
+{
+    return m_OutputSum;
+}
+inline uint16_t SmoothLed::milliamps(uint32_t outputSum, uint8_t channelMilliamps)
+{
+    return outputSum * channelMilliamps / 255;
+}
+inline uint16_t SmoothLed::getMilliamps() const
+{
+    return milliamps(m_OutputSum, m_ChannelMilliamps);
+}
+inline void SmoothLed::setChannelMilliamps(uint8_t milliamps)
+{
+    m_ChannelMilliamps = milliamps;
+}
+inline uint8_t SmoothLed::getChannelMilliamps() const
+{
+    return m_ChannelMilliamps;
+}
+#if SMOOTHLED_BRIGHTNESS
+inline void SmoothLed::setPowerLimit(uint16_t milliamps)
+{
+    changed();
+    m_PowerLimit = milliamps;
+    if (!milliamps)
+        m_PowerScale = 0xffff;
+}
+inline uint16_t SmoothLed::getPowerLimit() const
+{
+    return m_PowerLimit;
+}
+inline void SmoothLed::setPowerScale(uint16_t scale)
+{
+    changed();
+    m_PowerScale = scale;
+}
+inline uint16_t SmoothLed::getPowerScale() const
+{
+    return m_PowerScale;
+}
+#endif
+#endif
+// changing: the next frame will differ even if nothing is fading
+inline void SmoothLed::endFrame(uint32_t sent, bool changing)
+{
+#if SMOOTHLED_POWER_SUM
+    // the output is inverted, 0xff is off
+    m_OutputSum = uint32_t(m_NumInterpolators) * 255 - sent;
+#if SMOOTHLED_BRIGHTNESS
+    if (m_PowerLimit && m_ChannelMilliamps)
+    {
+        uint16_t scale = limitPower(m_PowerScale, m_OutputSum, uint32_t(m_PowerLimit) * 255 / m_ChannelMilliamps);
+        changing |= scale != m_PowerScale;
+        m_PowerScale = scale;
+    }
+#endif
+#else
+    (void) sent;
+#endif
+#if SMOOTHLED_IDLE_DETECT
+    m_Converged = !changing && !isFading();
+#else
+    (void) changing;
+#endif
+}
+inline void SmoothLed::changed()
+{
+#if SMOOTHLED_IDLE_DETECT
+    m_Converged = false;
+#endif
+}
+#if SMOOTHLED_IDLE_DETECT
+inline bool SmoothLed::isConverged() const
+{
+    return m_Converged;
+}
+inline void SmoothLed::wake()
+{
+    m_Converged = false;
+}
+#endif
+inline uint16_t SmoothLed::getFadePosition() const
+{
+    return m_Segments[0].getFadePosition();
+}
+inline uint16_t SmoothLed::getFadeRate() const
+{
+    return m_Segments[0].getFadeRate();
+}
+inline SmoothLed::Segment& SmoothLed::getSegment(uint8_t index)
+{
+    return m_Segments[index];
+}
+inline uint8_t SmoothLed::getNumSegments() const
+{
+    return m_NumSegments;
+}
+inline uint16_t SmoothLed::segmentLength(uint8_t index, uint16_t remaining) const
+{
+    // the last segment covers the rest of the strip
+    if (index + 1 == m_NumSegments)
+        return remaining;
+    return min(m_Segments[index].getNumInterpolators(), remaining);
+}
+inline uint16_t SmoothLed::getNumOutputs() const
+{
+    return m_NumOutputs;
+}
+inline void SmoothLed::setLatchMicros(uint16_t latchMicros)
+{
+    m_LatchMicros = latchMicros;
+}
+inline uint16_t SmoothLed::getLatchMicros() const
+{
+    return m_LatchMicros;
+}
+inline void SmoothLed::setAsyncBuffers(uint8_t* buffer0, uint8_t* buffer1, uint16_t size)
+{
+    m_AsyncBuffers[0] = buffer0;
+    m_AsyncBuffers[1] = buffer1 ? buffer1 : buffer0;
+    m_AsyncBufferSize = buffer0 ? size : 0;
+}
 inline void SmoothLed::clearFadeTarget()
 {
     clearFadeTarget(0, m_NumInterpolators);
 }
+inline void SmoothLed::cacheStatic(Interpolator& i, uint8_t gammaChannel) const
+{
+#if SMOOTHLED_STATIC_CACHE
+    i.hold(gammaCorrect(i.getValue(), gammaChannel));
+#else
+    (void) i;
+    (void) gammaChannel;
+#endif
+}
@@ -0,0 +1,124 @@
+#include "SmoothLedApa102.h"
+
+// 31 * 256 / current for each brightest >> 3 (current = that + 1, at most
+// 31), scaling a level up to fill the PWM range at the lower current.  Also
+// read by the kernel.
+extern "C" const uint16_t SmoothLedApa102Scale[32] =
+{
+    7936, 3968, 2645, 1984, 1587, 1322, 1133,  992,
+     881,  793,  721,  661,  610,  566,  529,  496,
+     466,  440,  417,  396,  377,  360,  345,  330,
+     317,  305,  293,  283,  273,  264,  256,  256,
+};
+
+#if SMOOTHLED_ASM_UPDATE
+extern "C" uint32_t SmoothLedUpdateApa102(
+    uint8_t count, SmoothLed::Interpolator* interpolators,
+    uint8_t dt, uint16_t ditherMask, uint16_t maxValue,
+    const void* gammaLut, uint16_t dim);
+#endif
+
+bool SmoothLedApa102::update()
+{
+    // set through a SmoothLed reference, the frame can't be mapped
+    if (m_Runs)
+        return false;
+    SPI0.CTRLB = SPI_SSD_bm | SPI_MODE_0_gc | SPI_BUFEN_bm;
+    SPI0.CTRLA = m_SpiCtrlA;
+    SPI0.INTFLAGS = SPI_TXCIF_bm;
+    // start frame
+    for (uint8_t n = 0; n < 4; ++n)
+        write(0);
+
+    uint16_t remaining = getNumInterpolators();
+    uint8_t ditherMask = getDitherMask();
+    uint16_t maxvalue = getMaxValue();
+    uint32_t levels = 0;
+    bool dithering = false;
+#if SMOOTHLED_ASM_UPDATE
+    const uint16_t* gammaLuts[SMOOTHLED_GAMMA_CHANNELS];
+#endif
+    for (uint8_t s = 0; s < m_NumSegments; ++s)
+    {
+        uint16_t index = m_NumInterpolators - remaining;
+        uint8_t dt = updateTime(s, index);
+        uint16_t dim = getKernelDim(m_Segments[s]);
+        uint16_t count = segmentLength(s, remaining);
+        remaining -= count;
+        uint16_t leds = count / ChannelsPerLed;
+        if (leds == 0)
+            continue;
+        Interpolator* i = m_Interpolators + index;
+#if SMOOTHLED_ASM_UPDATE
+        const void* gammaLut = getKernelGammaLuts(index, gammaLuts);
+        do {
+            uint8_t n = leds < KernelLeds ? leds : KernelLeds;
+            uint32_t result = SmoothLedUpdateApa102(n, i, dt, ditherMask, maxvalue, gammaLut, dim);
+            levels += result >> 16;
+            dithering |= result & KernelDithering;
+            i += n * ChannelsPerLed;
+            leds -= n;
+        } while (leds);
+#else
+        uint8_t gammaChannel = getGammaChannel(index);
+        do {
+            const uint16_t* luts[ChannelsPerLed];
+            uint8_t dither[ChannelsPerLed];
+            for (uint8_t c = 0; c < ChannelsPerLed; ++c)
+            {
+                luts[c] = m_GammaLuts[gammaChannel];
+                nextGammaChannel(gammaChannel);
+                dither[c] = i[c].dither;
+            }
+            uint8_t frame[1 + ChannelsPerLed];
+            levels += updateLed(i, frame, dt, luts, maxvalue, ditherMask, dim);
+            for (uint8_t c = 0; c < ChannelsPerLed; ++c)
+                dithering |= i[c].dither != dither[c];
+            for (uint8_t b = 0; b < sizeof(frame); ++b)
+                write(frame[b]);
+            i += ChannelsPerLed;
+        } while (--leds);
+#endif
+    }
+
+    // end frame: the SK9822 wants 32 zero bits and the APA102 half a clock
+    // per LED to pass the data along to the end of the strip
+    for (uint16_t n = 4 + (m_NumInterpolators / ChannelsPerLed + 15) / 16; n; --n)
+        write(0);
+    while ((SPI0.INTFLAGS & SPI_TXCIF_bm) == 0) {}
+    // endFrame takes the sum of inverted bytes that single wire LEDs are sent
+    endFrame(uint32_t(m_NumInterpolators) * 255 - levels, dithering);
+    return true;
+}
+
+uint16_t SmoothLedApa102::updateLed(Interpolator* i, uint8_t* frame, uint8_t dt, const uint16_t* const* gammaLuts,
+    uint16_t maxValue, uint8_t ditherMask, uint16_t dim)
+{
+    uint16_t levels[ChannelsPerLed];
+    uint8_t brightest = 0;
+    for (uint8_t c = 0; c < ChannelsPerLed; ++c)
+    {
+        // the gamma tables are inverted for the CCL, and can go a little
+        // past 0xff00 at the top
+        uint16_t level = 0xff00 - i[c].correct(dt, gammaLuts[c], maxValue, dim);
+        if (highByte(level) == 0xff)
+            level = 0xff00;
+        levels[c] = level;
+        if (highByte(level) > brightest)
+            brightest = highByte(level);
+    }
+    uint8_t current = brightest >> 3;
+    uint16_t scale = SmoothLedApa102Scale[current];
+    frame[0] = 0xe0 | (current < 31 ? current + 1 : 31);
+    uint16_t sum = 0;
+    for (uint8_t c = 0; c < ChannelsPerLed; ++c)
+    {
+        uint16_t level = levels[c];
+        sum += highByte(level);
+        // (level * scale) >> 8 without the low byte product, as in the kernel
+        uint16_t scaled = (highByte(level) * highByte(scale) << 8) +
+            highByte(level) * lowByte(scale) + lowByte(level) * highByte(scale);
+        frame[1 + c] = i[c].applyDither(scaled, ditherMask);
+    }
+    return sum;
+}
@@ -0,0 +1,83 @@
+// SmoothLED for tinyAVR-0/1 series
+
+#pragma once
+
+#include "SmoothLed.h"
+
+// Two wire (data and clock) LEDs such as the APA102 and SK9822, driven
+// straight from SPI0 without the CCL and TCB.  Each LED frame has a 5 bit
+// global current as well as the 8 bit PWM of its three channels: update
+// picks the lowest current that reaches the LED's brightest channel and
+// scales the channels up to match, so dim LEDs get up to 5 more bits before
+// dithering.  The clock can run at F_CPU / 2 so the update, at about 290
+// cycles per LED, is limited by the calculation rather than the LEDs.
+//
+// The strip is set up and faded through SmoothLed as usual, with the same
+// gamma tables.  Every LED has 3 channels so the number of interpolators
+// and the length of every segment must be multiples of 3.  Use begin and
+// update from this class rather than the SmoothLedCcl/SmoothLed ones, which
+// are for the single wire LEDs.
+class SmoothLedApa102 : public SmoothLed
+{
+public:
+    // SPI0 data (MOSI) and clock (SCK) pins
+    enum Pins { MOSI_PA1_SCK_PA3, MOSI_PC2_SCK_PC0 };
+    static const uint8_t ChannelsPerLed = 3;
+
+    using SmoothLed::SmoothLed;
+
+    // the SPI clock is F_CPU / clockDivider, rounded up to 2, 4, 8 ... 128
+    void begin(Pins pins = MOSI_PA1_SCK_PA3, uint8_t clockDivider = 2);
+    // false, sending nothing, if a mapping was set through a SmoothLed
+    // reference
+    bool update();
+
+    // One LED's frame as update sends it, the global current byte then the
+    // three channels, from i[0..2] and their gamma tables.  Returns the sum
+    // of the channel levels (255 for fully on, before the current scaling).
+    static uint16_t updateLed(Interpolator* i, uint8_t* frame, uint8_t dt, const uint16_t* const* gammaLuts,
+        uint16_t maxValue, uint8_t ditherMask, uint16_t dim = 0);
+
+    // SMOOTHLED_POWER_SUM: most LEDs per kernel call, keeping the gamma
+    // tables in step and the 16 bit sum from overflowing
+    static const uint8_t KernelLeds = SMOOTHLED_POWER_SUM ? 84 : 252;
+
+private:
+    // the update sends each LED's frame as it's worked out, so there's no
+    // mapping (see SmoothLed::setMapping)
+    using SmoothLed::setMapping;
+
+    static void write(uint8_t value);
+
+    uint8_t m_SpiCtrlA = SPI_CLK2X_bm | SPI_PRESC_DIV4_gc | SPI_MASTER_bm | SPI_ENABLE_bm;
+};
+
+inline void SmoothLedApa102::begin(Pins pins, uint8_t clockDivider)
+{
+    if (pins == MOSI_PC2_SCK_PC0)
+    {
+#ifdef VPORTC
+        PORTMUX.CTRLB |= PORTMUX_SPI0_ALTERNATE_gc;
+        VPORTC.DIR |= _BV(0) | _BV(2);
+#endif
+    }
+    else
+    {
+        PORTMUX.CTRLB &= ~PORTMUX_SPI0_ALTERNATE_gc;
+        VPORTA.DIR |= _BV(1) | _BV(3);
+    }
+    // F_CPU / 2, 4, 8 ... 128
+    static const uint8_t Prescalers[] = {
+        SPI_CLK2X_bm | SPI_PRESC_DIV4_gc, SPI_PRESC_DIV4_gc,
+        SPI_CLK2X_bm | SPI_PRESC_DIV16_gc, SPI_PRESC_DIV16_gc,
+        SPI_CLK2X_bm | SPI_PRESC_DIV64_gc, SPI_PRESC_DIV64_gc, SPI_PRESC_DIV128_gc };
+    uint8_t n = 0;
+    while (n < 6 && (2 << n) < clockDivider)
+        ++n;
+    m_SpiCtrlA = Prescalers[n] | SPI_MASTER_bm | SPI_ENABLE_bm;
+}
+inline void SmoothLedApa102::write(uint8_t value)
+{
+    while ((SPI0.INTFLAGS & SPI_DREIF_bm) == 0) {}
+    SPI0.DATA = value;
+}
@@ -2,6 +2,10 @@
 
 #include "SmoothLed.h"
 
+// Frames are kept by their time (frame number) so they can arrive in any
+// order.  update() fades towards the earliest one still to come, across any
+// missing frames before it; with none at all it carries on in the same
+// direction for up to the extrapolation limit and then holds.
 template<int Size, int NumBufferedFrames>
 class SmoothLedBuffer
 {
@@ -9,15 +13,29 @@ public:
     SmoothLedBuffer();
 
     void     reset();
+    // nullptr if time has already been reached (or is earlier than every
+    // frame waiting when they fill the buffer)
     uint8_t* getWriteBuffer(uint8_t time);
+    bool     decode(uint8_t time, const uint8_t* data, uint8_t length);
     void     update(uint8_t time, SmoothLed& leds, uint16_t startIndex = 0);
     uint8_t  getUsedEntries() const;
+    void     setExtrapolation(uint8_t frames) { m_MaxExtrapolated = frames; }
 
 private:
-    uint8_t m_ReadIndex;
-    uint8_t m_WriteIndex;
-    uint8_t m_UsedEntries;
-    uint8_t m_TimeToRun;
+    enum State : uint8_t { Empty, Played, Waiting };
+
+    uint8_t findEntry(uint8_t time) const; // NumBufferedFrames if not held
+
+    uint8_t m_Now; // time of the last update
+    bool    m_Running; // updated since the reset
+    // the entry the steps lead to by its time, NumBufferedFrames if none,
+    // and whether they are all zero
+    uint8_t m_Target;
+    uint8_t m_TargetTime;
+    bool    m_Still;
+    uint8_t m_Extrapolated;
+    uint8_t m_MaxExtrapolated = 1;
+    State   m_State[NumBufferedFrames];
     uint8_t m_Time[NumBufferedFrames];
     uint8_t m_Data[NumBufferedFrames][Size];
 };
@@ -30,47 +48,189 @@ inline SmoothLedBuffer<Size, NumBufferedFrames>::SmoothLedBuffer()
 template<int Size, int NumBufferedFrames>
 inline void SmoothLedBuffer<Size, NumBufferedFrames>::reset()
 {
-    m_ReadIndex = 0;
-    m_WriteIndex = -1;
-    m_UsedEntries = 0;
-    m_TimeToRun = 0;
+    m_Running = false;
+    m_Target = NumBufferedFrames;
+    m_Still = false;
+    m_Extrapolated = 0;
+    for (State& state : m_State)
+        state = Empty;
+}
+template<int Size, int NumBufferedFrames>
+uint8_t SmoothLedBuffer<Size, NumBufferedFrames>::findEntry(uint8_t time) const
+{
+    uint8_t n = 0;
+    for (; n < NumBufferedFrames; ++n)
+        if (m_State[n] != Empty && m_Time[n] == time)
+            break;
+    return n;
 }
 template<int Size, int NumBufferedFrames>
 uint8_t* SmoothLedBuffer<Size, NumBufferedFrames>::getWriteBuffer(uint8_t time)
 {
-    if (m_UsedEntries == 0 || m_Time[m_WriteIndex] != time)
+    // until the first update everything counts as to come
+    if (!m_Running)
+        m_Now = time - 1;
+    int8_t ahead = time - m_Now;
+    if (ahead <= 0)
+        return nullptr;
+    uint8_t n = findEntry(time);
+    if (n == NumBufferedFrames)
+    {
+        // take an empty entry, else the one played longest ago, else the
+        // earliest waiting as an overfull ring buffer would
+        int16_t oldest = 0x7fff;
+        for (uint8_t e = 0; e < NumBufferedFrames; ++e)
+        {
+            int16_t key = m_State[e] == Empty ? -0x8000 : int8_t(m_Time[e] - m_Now) - (m_State[e] == Played) * 256;
+            if (key < oldest)
+            {
+                n = e;
+                oldest = key;
+            }
+        }
+        if (oldest > ahead)
+            return nullptr;
+        m_Time[n] = time;
+    }
+    // (the data may change)
+    if (n == m_Target)
+        m_Target = NumBufferedFrames;
+    m_State[n] = Waiting;
+    return m_Data[n];
+}
+// Compressed entry: data[0] is how many frames before time the frame it is
+// relative to was (0 for none, i.e. relative to all zeros), then runs of
+//   0x00-0x7f: code + 1 deltas follow, one for each byte
+//   0x80-0xbf: code - 0x7f bytes unchanged
+//   0xc0-0xff: code - 0xbf bytes all change by the delta that follows
+// making up exactly Size bytes (see extras/packetCodec.py).  Fails if the
+// frame it is relative to isn't held any more or the data doesn't add up.
+template<int Size, int NumBufferedFrames>
+bool SmoothLedBuffer<Size, NumBufferedFrames>::decode(uint8_t time, const uint8_t* data, uint8_t length)
+{
+    if (length == 0)
+        return false;
+    uint16_t count = 0;
+    uint16_t i = 1;
+    while (i < length)
     {
-        if (m_UsedEntries < NumBufferedFrames)
-            ++m_UsedEntries;
-        else if (++m_ReadIndex == NumBufferedFrames)
-            m_ReadIndex = 0;
-        if (++m_WriteIndex == NumBufferedFrames)
-            m_WriteIndex = 0;
-        m_Time[m_WriteIndex] = time;
+        uint8_t code = data[i++];
+        uint8_t run = (code & (code & 0x80 ? 0x3f : 0x7f)) + 1;
+        count += run;
+        if (code < 0x80)
+            i += run;
+        else if (code >= 0xc0)
+            ++i;
     }
-    return m_Data[m_WriteIndex];
+    if (count != Size || i != length)
+        return false;
+
+    // all zeros is a single byte stepped over 0 at a time
+    static const uint8_t zero = 0;
+    const uint8_t* base = &zero;
+    uint8_t baseStep = 0;
+    if (data[0])
+    {
+        uint8_t n = findEntry(time - data[0]);
+        if (n == NumBufferedFrames)
+            return false;
+        // the new entry can take the base's slot, each byte is read just
+        // before it's written
+        base = m_Data[n];
+        baseStep = 1;
+    }
+
+    uint8_t* out = getWriteBuffer(time);
+    if (!out)
+        return false;
+    const uint8_t* end = data + length;
+    ++data;
+    while (data < end)
+    {
+        uint8_t code = *data++;
+        if (code < 0x80)
+        {
+            uint8_t run = code + 1;
+            do {
+                *out++ = *base + *data++;
+                base += baseStep;
+            } while (--run);
+        }
+        else
+        {
+            uint8_t run = (code & 0x3f) + 1;
+            uint8_t delta = code >= 0xc0 ? *data++ : 0;
+            do {
+                *out++ = *base + delta;
+                base += baseStep;
+            } while (--run);
+        }
+    }
+    return true;
 }
 template<int Size, int NumBufferedFrames>
 void SmoothLedBuffer<Size, NumBufferedFrames>::update(uint8_t time, SmoothLed& leds, uint16_t startIndex)
 {
-    if (m_TimeToRun > 0 && --m_TimeToRun > 0)
-        return;
-    const uint8_t* data = nullptr;
-    while (m_TimeToRun <= 0 && m_UsedEntries)
+    m_Now = time;
+    m_Running = true;
+    uint8_t next = NumBufferedFrames;
+    int8_t nextAhead = 127;
+    for (uint8_t n = 0; n < NumBufferedFrames; ++n)
+    {
+        if (m_State[n] != Waiting)
+            continue;
+        int8_t ahead = m_Time[n] - time;
+        // reached, or arrived too late (kept as a base to decode from)
+        if (ahead <= 0)
+            m_State[n] = Played;
+        else if (ahead < nextAhead)
+        {
+            next = n;
+            nextAhead = ahead;
+        }
+    }
+    if (next < NumBufferedFrames)
     {
-        data = m_Data[m_ReadIndex];
-        m_TimeToRun = m_Time[m_ReadIndex] - time;
-        if (++m_ReadIndex == NumBufferedFrames) 
-            m_ReadIndex = 0;
-        --m_UsedEntries;
+        m_Extrapolated = 0;
+        // Frames missing before it are faded across, and if one of them
+        // turns up later the fade is redone towards it.  Recalculating the
+        // steps is the expensive part so they are left alone while they
+        // still lead there, and when the frame just reached is the same
+        // they only need stopping, once.
+        if (next == m_Target && m_Time[next] == m_TargetTime)
+            return;
+        bool reached = m_Target < NumBufferedFrames && m_TargetTime == time;
+        if (reached && memcmp(m_Data[next], m_Data[m_Target], Size) == 0)
+        {
+            if (!m_Still)
+                leds.clearFadeTarget(startIndex, Size);
+            m_Still = true;
+        }
+        else
+        {
+            leds.setFadeTarget(startIndex, m_Data[next], Size, uint16_t(0x8000) / uint8_t(nextAhead));
+            m_Still = false;
+        }
+        m_Target = next;
+        m_TargetTime = m_Time[next];
     }
-    if (m_TimeToRun > 0)
-        leds.setFadeTarget(startIndex, data, Size, uint16_t(0x8000) / m_TimeToRun);
     else
-        leds.clearFadeTarget(startIndex, Size);
+    {
+        m_Target = NumBufferedFrames;
+        if (m_Extrapolated < m_MaxExtrapolated)
+            ++m_Extrapolated; // the last fade's steps carry on
+        else if (!m_Still)
+        {
+            leds.clearFadeTarget(startIndex, Size);
+            m_Still = true;
+        }
+    }
 }
 template<int Size, int NumBufferedFrames>
 inline uint8_t SmoothLedBuffer<Size, NumBufferedFrames>::getUsedEntries() const
 {
-    return m_UsedEntries;
+    uint8_t used = 0;
+    for (State state : m_State)
+        used += state == Waiting;
+    return used;
 }
@@ -0,0 +1,6 @@
+#include "SmoothLedCcl.h"
+
+const uint8_t* volatile SmoothLedCcl::s_AsyncData;
+volatile uint16_t SmoothLedCcl::s_AsyncCount;
+volatile bool SmoothLedCcl::s_AsyncBusy;
+void (*SmoothLedCcl::s_AsyncCallback)();
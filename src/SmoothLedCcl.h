@@ -39,6 +39,15 @@ public:
 
     bool isSpi() const;
 
+    // interrupt driven output (SPI only): begins the transaction, sends count
+    // bytes from data in the background and ends the transaction, calling
+    // callback from the interrupt once the last byte has been sent.  The data
+    // must stay valid until isBusy returns false.  With count 0 the callback
+    // is called straight away.  Requires SMOOTHLED_SPI_ISR() in the sketch.
+    void writeAsync(const uint8_t* data, uint16_t count, void (*callback)() = nullptr);
+    static bool isBusy();
+    static void handleSpiInterrupt();
+
     // internal peripheral setup used by begin:
     void beginTimer(ClockSetting sck, volatile TCB_t& tcb, int lowPulseNs, int highPulseNs);
     void beginCclLut(Lut lut, volatile TCB_t& tcb, bool enable = false);
@@ -53,8 +62,18 @@ private:
 
     uint8_t m_Spi;
     uint8_t m_HighCycles;
+
+    static const uint8_t* volatile s_AsyncData;
+    static volatile uint16_t s_AsyncCount;
+    static volatile bool s_AsyncBusy;
+    static void (*s_AsyncCallback)();
 };
 
+// megaTinyCore's Serial owns the USART DRE interrupt so asynchronous output
+// uses SPI0.  Put this in one source file of the sketch (unless it defines
+// its own SPI0_INT_vect handler).
+#define SMOOTHLED_SPI_ISR() ISR(SPI0_INT_vect) { SmoothLedCcl::handleSpiInterrupt(); }
+
 inline void SmoothLedCcl::begin(OutputPinLut outpin, ClockSetting sck,
     volatile TCB_t& tcb, int lowPulseNs, int highPulseNs)
 {
@@ -262,6 +281,51 @@ inline void SmoothLedCcl::endTransactionUsart()
     while ((USART0.STATUS & USART_TXCIF_bm) == 0) {}
     CCL.CTRLA &= ~CCL_ENABLE_bm;
 }
+inline void SmoothLedCcl::writeAsync(const uint8_t* data, uint16_t count, void (*callback)())
+{
+    // the interrupt sends a byte before counting down
+    if (count == 0)
+    {
+        if (callback)
+            callback();
+        return;
+    }
+    s_AsyncData = data;
+    s_AsyncCount = count;
+    s_AsyncCallback = callback;
+    s_AsyncBusy = true;
+    beginTransactionSpi();
+    // the first interrupt fires straight away as the data register is empty
+    SPI0.INTCTRL = SPI_DREIE_bm;
+}
+inline bool SmoothLedCcl::isBusy()
+{
+    return s_AsyncBusy;
+}
+inline void SmoothLedCcl::handleSpiInterrupt()
+{
+    if (SPI0.INTCTRL & SPI_DREIE_bm)
+    {
+        const uint8_t* data = s_AsyncData;
+        SPI0.DATA = *data++;
+        s_AsyncData = data;
+        if (--s_AsyncCount == 0)
+        {
+            // wait for the last byte to leave the shift register
+            SPI0.INTFLAGS = SPI_TXCIF_bm;
+            SPI0.INTCTRL = SPI_TXCIE_bm;
+        }
+    }
+    else
+    {
+        SPI0.INTFLAGS = SPI_TXCIF_bm;
+        SPI0.INTCTRL = 0;
+        CCL.CTRLA &= ~CCL_ENABLE_bm;
+        s_AsyncBusy = false;
+        if (s_AsyncCallback)
+            s_AsyncCallback();
+    }
+}
 inline int SmoothLedCcl::nsToCycles(int ns)
 {
     return (ns * (F_CPU / 1000000) + 500) / 1000;
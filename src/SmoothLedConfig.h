@@ -0,0 +1,103 @@
+// SmoothLED for tinyAVR-0/1 series
+// Compile time options shared by the C++ and assembly sources.
+
+#pragma once
+
+// Use the hand written assembly update loops in SmoothLedUpdate.S.
+#ifndef SMOOTHLED_ASM_UPDATE
+#define SMOOTHLED_ASM_UPDATE 1
+#endif
+
+// Cache the gamma corrected value of channels that aren't fading so the
+// update only has to apply dithering to them (roughly 23 instead of 58
+// cycles per byte, at the cost of 2 extra cycles for fading channels).
+// While a channel is cached bit 15 of Interpolator::value is set and
+// Interpolator::step holds the corrected value; use Interpolator::getValue
+// to read the position.  The SmoothLed set/clear/setFadeTarget functions
+// maintain the cache, Interpolator::set/stop just invalidate it, and a
+// segment's channels are cached again on the frame its fade ends (which
+// drops their steps, so beginFade without new targets leaves them still).
+#ifndef SMOOTHLED_STATIC_CACHE
+#define SMOOTHLED_STATIC_CACHE 0
+#endif
+
+// Store each channel in 4 bytes instead of 5 (25% more LEDs for the same
+// memory) by keeping Interpolator::step as an 8 bit value in units of
+// 1 << SMOOTHLED_COMPACT_STEP_SHIFT.  Fade end points are rounded to the
+// nearest step unit, and a fraction too small to make a whole unit still
+// moves one towards a target half a unit or more away; the fade itself
+// still moves in 16 bit steps.  A shift of 6 covers the full range of
+// gamma tables with up to 32 entries, use 7 for 64 entries and 8 for 128.
+#ifndef SMOOTHLED_COMPACT_INTERPOLATOR
+#define SMOOTHLED_COMPACT_INTERPOLATOR 0
+#endif
+#ifndef SMOOTHLED_COMPACT_STEP_SHIFT
+#define SMOOTHLED_COMPACT_STEP_SHIFT 6
+#endif
+
+// Number of gamma tables, used in turn for consecutive channels so e.g. with
+// 3 the red, green and blue channels of an RGB strip each get their own
+// curve (set it to LED_CHANNELS, see SmoothLed::setGammaLuts).  The second
+// table costs about 2 cycles per byte and each one after that about 1
+// (buffered update 58.1, 60.3, 61.3 and 62.4 cycles per byte for 1 to 4
+// tables with extras/benchmarkUpdate.py).
+#ifndef SMOOTHLED_GAMMA_CHANNELS
+#define SMOOTHLED_GAMMA_CHANNELS 1
+#endif
+
+// Scale every channel by a fadeable master brightness (SmoothLed::
+// setBrightness) before gamma correction, so dimming keeps the full 16 bit
+// resolution of the fade instead of shrinking the 8 bit output range.
+// Costs 13 cycles per byte.
+#ifndef SMOOTHLED_BRIGHTNESS
+#define SMOOTHLED_BRIGHTNESS 0
+#endif
+
+// Add up the bytes sent by every update (2 cycles per byte) for
+// SmoothLed::getOutputSum/getMilliamps and, with SMOOTHLED_BRIGHTNESS,
+// the power limiter (SmoothLed::setPowerLimit).
+#ifndef SMOOTHLED_POWER_SUM
+#define SMOOTHLED_POWER_SUM 0
+#endif
+
+// Track whether the last frame sent will repeat until the LEDs are changed
+// (SmoothLed::isConverged) so idle updates can be skipped.  Costs 2 cycles
+// per byte.
+#ifndef SMOOTHLED_IDLE_DETECT
+#define SMOOTHLED_IDLE_DETECT 0
+#endif
+
+// CPU cycles per byte sent to single wire LEDs over USART, 16 times the
+// high pulse cycles SmoothLedCcl::begin works out.  The default is for
+// begin's default 600ns high pulse, define it if you pass another.
+#ifndef SMOOTHLED_BYTE_CYCLES
+#define SMOOTHLED_BYTE_CYCLES (16 * ((600 * (F_CPU / 1000000) + 500) / 1000))
+#endif
+
+// Cycles per byte of the USART update that also sets fade targets, for the
+// options above (measured with extras/benchmarkUpdate.py: 106.3, 108.4,
+// 109.4 and 110.5 with 1 to 4 gamma tables)
+#define SMOOTHLED_FUSED_CYCLES (106 + 11 * SMOOTHLED_COMPACT_INTERPOLATOR + 6 * SMOOTHLED_STATIC_CACHE + \
+    (SMOOTHLED_GAMMA_CHANNELS > 1) + (SMOOTHLED_GAMMA_CHANNELS - 1) + \
+    13 * SMOOTHLED_BRIGHTNESS + 2 * SMOOTHLED_POWER_SUM + 2 * SMOOTHLED_IDLE_DETECT)
+
+// Have SmoothLed::updateAndSetFadeTarget work out the fade targets in the
+// USART update while it waits for each byte to go.  On by default where
+// that still keeps up with the USART (16MHz and above with the default
+// timing), elsewhere the two run one after the other.
+#ifndef SMOOTHLED_FUSED_TARGETS
+#define SMOOTHLED_FUSED_TARGETS (SMOOTHLED_BYTE_CYCLES >= SMOOTHLED_FUSED_CYCLES)
+#endif
+
+#if SMOOTHLED_COMPACT_INTERPOLATOR && SMOOTHLED_STATIC_CACHE
+#error SMOOTHLED_STATIC_CACHE needs the 16 bit step of the full size Interpolator
+#endif
+#if SMOOTHLED_COMPACT_STEP_SHIFT < 6 || SMOOTHLED_COMPACT_STEP_SHIFT > 8
+#error SMOOTHLED_COMPACT_STEP_SHIFT must be 6, 7 or 8
+#endif
+#if SMOOTHLED_GAMMA_CHANNELS < 1 || SMOOTHLED_GAMMA_CHANNELS > 4
+#error SMOOTHLED_GAMMA_CHANNELS must be 1 to 4
+#endif
+#if SMOOTHLED_BRIGHTNESS && SMOOTHLED_STATIC_CACHE
+#error SMOOTHLED_BRIGHTNESS needs the ungamma corrected values that SMOOTHLED_STATIC_CACHE replaces
+#endif
@@ -0,0 +1,131 @@
+// SmoothLED for tinyAVR-0/1 series
+// Compile time gamma table generation (needs C++14, the megaTinyCore default
+// is gnu++17).  The tables match extras/makeGammaTable.py and, like any other
+// const data, live in flash:
+//
+//   constexpr auto Gamma22 = smoothled::makeGammaTable<32>(2.2);
+//   leds.setGammaLut(Gamma22);
+//
+// For white balance make one table per channel with the channel's
+// brightness scale, e.g. makeGammaTable<32>(2.5, 1.0, 0.8) for red.
+
+#pragma once
+
+#include <stdint.h>
+
+namespace smoothled {
+
+template<uint8_t Size>
+struct GammaTable
+{
+    static_assert(Size >= 2 && Size <= 128, "gamma tables must have 2 to 128 entries");
+    static const uint8_t NumEntries = Size;
+    uint16_t entries[Size];
+};
+
+namespace gammatable {
+
+// avr-gcc's double is only 32 bits, so the maths is done in 64 bit fixed
+// point to get the same results as the python script on every compiler.
+// Parameters are converted to millionths first.
+constexpr uint8_t Bits = 56;
+constexpr int64_t One = int64_t(1) << Bits;
+constexpr int64_t Ln2 = 49946518145322874; // ln(2) << 56
+constexpr uint32_t ParamScale = 1000000;
+
+constexpr uint32_t param(double value)
+{
+    return uint32_t(value * ParamScale + 0.5);
+}
+
+// (a * b) >> Bits without a 128 bit intermediate
+constexpr uint64_t umul(uint64_t a, uint64_t b)
+{
+    uint64_t a1 = a >> 32, a0 = a & 0xffffffff;
+    uint64_t b1 = b >> 32, b0 = b & 0xffffffff;
+    return ((a1 * b1) << (64 - Bits)) + ((a1 * b0) >> (Bits - 32)) +
+           ((a0 * b1) >> (Bits - 32)) + ((a0 * b0) >> Bits);
+}
+constexpr int64_t mul(int64_t a, int64_t b)
+{
+    return (a < 0) != (b < 0) ? -int64_t(umul(a < 0 ? -a : a, b < 0 ? -b : b))
+                              : int64_t(umul(a < 0 ? -a : a, b < 0 ? -b : b));
+}
+
+// (n << Bits) / d for n < 2 * d by long division
+constexpr int64_t divide(uint64_t n, uint64_t d)
+{
+    uint64_t q = 0;
+    for (uint8_t bit = 0; bit <= Bits; ++bit)
+    {
+        q <<= 1;
+        if (n >= d)
+        {
+            n -= d;
+            q |= 1;
+        }
+        n <<= 1;
+    }
+    return q;
+}
+
+// ln(n / d) for n, d > 0 and below 2^52
+constexpr int64_t ln(uint64_t n, uint64_t d)
+{
+    // n / d = m * 2^k with m in [1, 2)
+    int8_t k = 0;
+    while (n >= 2 * d) { d <<= 1; ++k; }
+    while (n < d) { n <<= 1; --k; }
+    // ln(m) = 2 * atanh(z) = 2 * (z + z^3/3 + z^5/5 + ...), z = (m - 1) / (m + 1)
+    int64_t z = divide(n - d, n + d);
+    int64_t z2 = mul(z, z);
+    int64_t sum = 0;
+    for (int64_t power = z, i = 1; power; power = mul(power, z2), i += 2)
+        sum += power / i;
+    return 2 * sum + k * Ln2;
+}
+
+constexpr int64_t exp(int64_t x)
+{
+    // e^x = e^r * 2^k with r in [0, ln(2))
+    int8_t k = 0;
+    while (x < 0) { x += Ln2; --k; }
+    while (x >= Ln2) { x -= Ln2; ++k; }
+    int64_t sum = One;
+    for (int64_t term = x, i = 2; term; term = mul(term, x) / i, ++i)
+        sum += term;
+    return k <= -63 ? 0 : k < 0 ? sum >> -k : sum << k;
+}
+
+// entry i of the table: 0xff00 - round(x^gamma * 0xff00) with
+// x = i * brightness / (size - 1) * maxvalue / (maxvalue - 1)
+constexpr uint16_t entry(uint8_t i, uint8_t size, uint32_t gamma, uint64_t brightness)
+{
+    if (i == 0 || brightness == 0)
+        return 0xff00;
+    uint64_t maxValue = (size - 1) * 256;
+    uint64_t n = i * brightness * maxValue;
+    uint64_t d = (size - 1) * (maxValue - 1) * ParamScale;
+    int64_t g = (gamma / ParamScale) * One + divide(gamma % ParamScale, ParamScale);
+    int64_t power = exp(mul(ln(n, d), g));
+    int64_t corrected = ((power >> 16) * 0xff00 + (int64_t(1) << (Bits - 17))) >> (Bits - 16);
+    return uint16_t(0xff00 - corrected);
+}
+
+} // namespace gammatable
+
+// Inverted gamma table with the same entries as
+// makeGammaTable.py --gamma gamma --maxbright maxbright * balance --tablesize Size
+// (gamma and the brightness are rounded to 6 decimal places).
+template<uint8_t Size>
+constexpr GammaTable<Size> makeGammaTable(double gamma = 2.5, double maxbright = 1.0, double balance = 1.0)
+{
+    GammaTable<Size> table = {};
+    uint32_t g = gammatable::param(gamma);
+    uint32_t b = gammatable::param(maxbright * balance);
+    for (uint8_t i = 0; i < Size; ++i)
+        table.entries[i] = gammatable::entry(i, Size, g, b);
+    return table;
+}
+
+} // namespace smoothled
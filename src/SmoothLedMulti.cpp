@@ -0,0 +1,202 @@
+#include "SmoothLedMulti.h"
+
+struct SmoothLedKernelParams
+{
+    SmoothLed::Interpolator* interpolators;
+    const void* gammaLut; // see SmoothLed::getKernelGammaLuts
+    uint16_t maxValue;
+    uint8_t dt;
+    uint8_t ditherMask;
+    uint16_t dim; // see SmoothLed::Segment::getDim
+};
+
+struct SmoothLedDualParams
+{
+    SmoothLedKernelParams strips[2];
+#if SMOOTHLED_GAMMA_CHANNELS > 1
+    // {spi, usart} tables for each channel, in order from the first one
+    // sent, then {nullptr, nullptr}
+    const uint16_t* gammaLuts[SMOOTHLED_GAMMA_CHANNELS + 1][2];
+#endif
+};
+
+// SMOOTHLED_POWER_SUM: most byte pairs per SmoothLedUpdateDual call
+static const uint16_t DualSumChunk = SMOOTHLED_POWER_SUM ?
+    128 / SMOOTHLED_GAMMA_CHANNELS * SMOOTHLED_GAMMA_CHANNELS : 0xffff;
+
+#if SMOOTHLED_ASM_UPDATE
+extern "C" uint32_t SmoothLedUpdateDual(uint16_t count, const SmoothLedDualParams* params);
+
+extern "C" uint32_t SmoothLedUpdate8cpb(
+    uint16_t count, SmoothLed::Interpolator * interpolators,
+    register8_t& outport,
+    uint8_t dt, uint16_t ditherMask, uint16_t maxValue,
+    const void* gammaLut, register8_t& statusport, uint16_t dim);
+#else
+static uint8_t updateChannel(const SmoothLed& leds, const SmoothLedKernelParams& p, uint16_t n, uint16_t index,
+    bool& dithering)
+{
+    const uint16_t* gammaLut = leds.getGammaLut(SmoothLed::getGammaChannel(index + n));
+    SmoothLed::Interpolator& i = p.interpolators[n];
+    uint8_t dither = i.dither;
+    uint8_t value = i.update(p.dt, gammaLut, p.maxValue, p.ditherMask, p.dim);
+    dithering |= i.dither != dither;
+    return value;
+}
+#endif
+
+void SmoothLedMulti::update()
+{
+    // a mapped strip (see SmoothLed::setMapping) has to be worked out whole
+    // before it's sent, so the strips go one after the other
+    if (m_SpiLeds.m_Runs || m_UsartLeds.m_Runs)
+    {
+        m_SpiLeds.updateSpi();
+        m_UsartLeds.updateUsart();
+#if SMOOTHLED_POWER_SUM
+        m_OutputSum = m_SpiLeds.getOutputSum() + m_UsartLeds.getOutputSum();
+#if SMOOTHLED_BRIGHTNESS
+        limitPower();
+#endif
+#endif
+        return;
+    }
+
+    SmoothLed* leds[2] = { &m_SpiLeds, &m_UsartLeds };
+    SmoothLedDualParams params;
+    uint8_t segment[2];
+    uint16_t remaining[2]; // channels left in the current segment
+    uint16_t index[2];
+    uint32_t sent = 0;
+    bool dithering = false;
+#if SMOOTHLED_ASM_UPDATE && SMOOTHLED_GAMMA_CHANNELS > 1
+    params.gammaLuts[SMOOTHLED_GAMMA_CHANNELS][0] = params.gammaLuts[SMOOTHLED_GAMMA_CHANNELS][1] = nullptr;
+#endif
+    for (uint8_t n = 0; n < 2; ++n)
+    {
+        SmoothLedKernelParams& p = params.strips[n];
+        p.interpolators = leds[n]->getInterpolators();
+        p.maxValue = leds[n]->getMaxValue();
+        p.ditherMask = leds[n]->getDitherMask();
+        segment[n] = 0;
+        remaining[n] = 0;
+        index[n] = 0;
+    }
+    m_SpiLeds.beginTransactionSpi();
+    m_UsartLeds.beginTransactionUsart();
+    for (;;)
+    {
+        // move on to the next segment with any channels, advancing the fade
+        // clocks of any empty ones on the way
+        for (uint8_t n = 0; n < 2; ++n)
+        {
+            while (remaining[n] == 0 && segment[n] < leds[n]->getNumSegments())
+            {
+                params.strips[n].dt = leds[n]->updateTime(segment[n], index[n]);
+                params.strips[n].dim = leds[n]->getKernelDim(leds[n]->getSegment(segment[n]));
+                remaining[n] = leds[n]->getSegmentLength(segment[n]++);
+            }
+        }
+        uint16_t count = min(min(remaining[0], remaining[1]), DualSumChunk);
+        if (count)
+        {
+#if SMOOTHLED_ASM_UPDATE
+#if SMOOTHLED_GAMMA_CHANNELS > 1
+            for (uint8_t c = 0; c < SMOOTHLED_GAMMA_CHANNELS; ++c)
+                for (uint8_t n = 0; n < 2; ++n)
+                    params.gammaLuts[c][n] = leds[n]->getGammaLut(SmoothLed::getGammaChannel(index[n] + c));
+#else
+            for (uint8_t n = 0; n < 2; ++n)
+                params.strips[n].gammaLut = leds[n]->getGammaLut();
+#endif
+            uint32_t result = SmoothLedUpdateDual(count, &params);
+            sent += result >> 16;
+            dithering |= result & SmoothLed::KernelDithering;
+#else
+            for (uint16_t c = 0; c < count; ++c)
+            {
+                uint8_t value = updateChannel(m_SpiLeds, params.strips[0], c, index[0], dithering);
+                while ((SPI0.INTFLAGS & SPI_DREIF_bm) == 0) {}
+                SPI0.DATA = value;
+                sent += value;
+                value = updateChannel(m_UsartLeds, params.strips[1], c, index[1], dithering);
+                while ((USART0.STATUS & USART_DREIF_bm) == 0) {}
+                USART0.TXDATAL = value;
+                sent += value;
+            }
+#endif
+        }
+        else if (remaining[0] || remaining[1])
+        {
+            // finish off the longer strip on its own
+            uint8_t n = remaining[0] ? 0 : 1;
+            register8_t& data = n ? USART0.TXDATAL : SPI0.DATA;
+            register8_t& status = n ? USART0.STATUS : SPI0.INTFLAGS;
+            SmoothLedKernelParams& p = params.strips[n];
+            count = min(remaining[n], SmoothLed::KernelSumChunk);
+#if SMOOTHLED_ASM_UPDATE
+            const uint16_t* gammaLuts[SMOOTHLED_GAMMA_CHANNELS];
+            p.gammaLut = leds[n]->getKernelGammaLuts(index[n], gammaLuts);
+            uint32_t result = SmoothLedUpdate8cpb(count, p.interpolators, data,
+                p.dt, p.ditherMask, p.maxValue, p.gammaLut, status, p.dim);
+            sent += result >> 16;
+            dithering |= result & SmoothLed::KernelDithering;
+#else
+            for (uint16_t c = 0; c < count; ++c)
+            {
+                uint8_t value = updateChannel(*leds[n], p, c, index[n], dithering);
+                while ((status & USART_DREIF_bm) == 0) {}
+                data = value;
+                sent += value;
+            }
+#endif
+        }
+        else
+            break;
+        for (uint8_t n = 0; n < 2; ++n)
+        {
+            if (remaining[n])
+            {
+                remaining[n] -= count;
+                index[n] += count;
+                params.strips[n].interpolators += count;
+            }
+        }
+    }
+    m_SpiLeds.endTransactionSpi();
+    m_UsartLeds.endTransactionUsart();
+    bool changing = dithering;
+#if SMOOTHLED_POWER_SUM
+    // the output is inverted, 0xff is off
+    m_OutputSum = (uint32_t(m_SpiLeds.getNumInterpolators()) + m_UsartLeds.getNumInterpolators()) * 255 - sent;
+#if SMOOTHLED_BRIGHTNESS
+    changing |= limitPower();
+#endif
+#else
+    (void) sent;
+#endif
+#if SMOOTHLED_IDLE_DETECT
+    // only the combined dithering flag is known, so both strips get it
+    for (uint8_t n = 0; n < 2; ++n)
+        leds[n]->m_Converged = !changing && !leds[n]->isFading();
+#else
+    (void) changing;
+#endif
+}
+
+#if SMOOTHLED_POWER_SUM && SMOOTHLED_BRIGHTNESS
+bool SmoothLedMulti::limitPower()
+{
+    if (!m_PowerLimit || !m_SpiLeds.getChannelMilliamps())
+        return false;
+    uint32_t budget = uint32_t(m_PowerLimit) * 255 / m_SpiLeds.getChannelMilliamps();
+    uint16_t scale = SmoothLed::limitPower(m_SpiLeds.getPowerScale(), m_OutputSum, budget);
+    // setPowerScale marks the strips changed, which would keep idle
+    // detection from ever seeing them converge
+    if (scale == m_SpiLeds.getPowerScale())
+        return false;
+    m_SpiLeds.setPowerScale(scale);
+    m_UsartLeds.setPowerScale(scale);
+    return true;
+}
+#endif
@@ -0,0 +1,107 @@
+// SmoothLED for tinyAVR-0/1 series
+
+#pragma once
+
+#include "SmoothLed.h"
+
+// Updates an SPI strip and a USART strip together, calculating the next
+// byte for one strip while the other one is sending.  Each strip keeps its
+// own fade clock, gamma table and dither mask and the strips can be
+// different lengths.  Both must be started with begin using different CCL
+// LUTs and TCB timers (see the TwoStrips example).  This halves the frame
+// time when sending rather than calculating is the limit, i.e. at 16MHz
+// and above.  A strip with a mapping (SmoothLed::setMapping) can't be
+// interleaved, so then the two strips are updated one after the other.
+class SmoothLedMulti
+{
+public:
+    SmoothLedMulti(SmoothLed& spiLeds, SmoothLed& usartLeds);
+
+    void update();
+
+    SmoothLed& getSpiLeds();
+    SmoothLed& getUsartLeds();
+
+#if SMOOTHLED_IDLE_DETECT
+    // both strips converged (see SmoothLed::isConverged)
+    bool isConverged() const;
+#endif
+
+#if SMOOTHLED_POWER_SUM
+    // Both strips together (see SmoothLed::getOutputSum), using the SPI
+    // strip's channel current.  The strips' own sums aren't updated.
+    uint32_t getOutputSum() const;
+    uint16_t getMilliamps() const;
+#if SMOOTHLED_BRIGHTNESS
+    // Budget for both strips, applied by setting the same power scale on
+    // each of them (see SmoothLed::setPowerLimit)
+    void setPowerLimit(uint16_t milliamps);
+    uint16_t getPowerLimit() const;
+#endif
+#endif
+
+private:
+#if SMOOTHLED_POWER_SUM && SMOOTHLED_BRIGHTNESS
+    // apply m_PowerLimit to both strips from m_OutputSum, whether it changed
+    bool limitPower();
+#endif
+
+    SmoothLed& m_SpiLeds;
+    SmoothLed& m_UsartLeds;
+#if SMOOTHLED_POWER_SUM
+    uint32_t m_OutputSum;
+#if SMOOTHLED_BRIGHTNESS
+    uint16_t m_PowerLimit;
+#endif
+#endif
+};
+
+inline SmoothLedMulti::SmoothLedMulti(SmoothLed& spiLeds, SmoothLed& usartLeds)
+    : m_SpiLeds(spiLeds), m_UsartLeds(usartLeds)
+{
+#if SMOOTHLED_POWER_SUM
+    m_OutputSum = 0;
+#if SMOOTHLED_BRIGHTNESS
+    m_PowerLimit = 0;
+#endif
+#endif
+}
+inline SmoothLed& SmoothLedMulti::getSpiLeds()
+{
+    return m_SpiLeds;
+}
+inline SmoothLed& SmoothLedMulti::getUsartLeds()
+{
+    return m_UsartLeds;
+}
+#if SMOOTHLED_IDLE_DETECT
+inline bool SmoothLedMulti::isConverged() const
+{
+    return m_SpiLeds.isConverged() && m_UsartLeds.isConverged();
+}
+#endif
+#if SMOOTHLED_POWER_SUM
+inline uint32_t SmoothLedMulti::getOutputSum() const
+{
+    return m_OutputSum;
+}
+inline uint16_t SmoothLedMulti::getMilliamps() const
+{
+    return SmoothLed::milliamps(m_OutputSum, m_SpiLeds.getChannelMilliamps());
+}
+#if SMOOTHLED_BRIGHTNESS
+inline void SmoothLedMulti::setPowerLimit(uint16_t milliamps)
+{
+    m_PowerLimit = milliamps;
+    if (!milliamps)
+    {
+        m_SpiLeds.setPowerScale(0xffff);
+        m_UsartLeds.setPowerScale(0xffff);
+    }
+}
+inline uint16_t SmoothLedMulti::getPowerLimit() const
+{
+    return m_PowerLimit;
+}
+#endif
+#endif
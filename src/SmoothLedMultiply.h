@@ -2,6 +2,8 @@
 
 namespace smoothled {
 
+#if defined(__AVR__)
+
 inline int16_t mac(int16_t value, int16_t a, uint8_t b)
 {
     // value += (a * b) >> 8   9 cycles
@@ -74,6 +76,24 @@ inline int16_t fmul(int16_t delta, uint16_t fraction)
     return result;
 }
 
+#else
+
+// portable versions with identical rounding for host builds (see extras/host)
+inline int16_t mac(int16_t value, int16_t a, uint8_t b)
+{
+    return value + ((int32_t(a) * b) >> 8);
+}
+inline int16_t fmac(int16_t value, int16_t a, uint8_t b)
+{
+    return value + ((int32_t(a) * b) >> 7);
+}
+inline int16_t fmul(int16_t delta, uint16_t fraction)
+{
+    return (int32_t(delta) * fraction) >> 15;
+}
+
+#endif
+
 inline uint16_t lerp(uint16_t a, uint16_t b, uint8_t t)
 {
     return mac(a, b - a, t);
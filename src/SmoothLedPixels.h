@@ -0,0 +1,140 @@
+#pragma once
+
+#include "SmoothLed.h"
+
+// Channel orders for SmoothLedPixels: where red, green, blue and white go
+// within each LED's channels (White is only used with 4 channels)
+namespace smoothled {
+
+template<uint8_t R, uint8_t G, uint8_t B, uint8_t W = 0xff>
+struct ChannelOrder
+{
+    static const uint8_t Channels = W == 0xff ? 3 : 4;
+    static const uint8_t Red = R, Green = G, Blue = B, White = W;
+};
+
+typedef ChannelOrder<0, 1, 2>    RGB;
+typedef ChannelOrder<1, 0, 2>    GRB;  // WS2812
+typedef ChannelOrder<2, 1, 0>    BGR;  // APA102, SK9822
+typedef ChannelOrder<0, 1, 2, 3> RGBW;
+typedef ChannelOrder<1, 0, 2, 3> GRBW; // SK6812 RGBW
+
+// picks overloads by channel count (no <type_traits> on avr-gcc)
+template<bool Condition, class T = void> struct EnableIf {};
+template<class T> struct EnableIf<true, T> { typedef T Type; };
+
+} // namespace smoothled
+
+// Whole LED access to a SmoothLed, e.g. SmoothLedPixels<smoothled::GRB>
+// pixels(leds).  Each call arranges the colour in the strip's channel order
+// at compile time and hands all of an LED's channels (or a run of LEDs) to
+// the bulk set/setFadeTarget in one go, so the strip is only marked changed
+// and the gamma range looked up once rather than per channel.  Pixels are
+// numbered from 0; like SmoothLed there is no bounds check.  White is
+// ignored for 3 channel orders.
+template<class Order>
+class SmoothLedPixels
+{
+public:
+    static const uint8_t Channels = Order::Channels;
+
+    explicit SmoothLedPixels(SmoothLed& leds) : m_Leds(leds) {}
+
+    uint16_t getNumPixels() const { return m_Leds.getNumInterpolators() / Channels; }
+
+    // jump straight to the colour
+    void setPixel(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b, uint8_t w = 0);
+    // fade to it over the fade started by beginFade, or cover fraction
+    // (Q1.15, 0x8000 = 1.0) of the remaining distance as setFadeTarget does
+    void fadePixel(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b, uint8_t w = 0);
+    void fadePixel(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b, uint8_t w, uint16_t fraction);
+    // fade count pixels from first to the same colour, or cover fraction of
+    // the distance as fadePixel does.  The fraction follows blue for 3
+    // channel orders and white for 4 channel orders.
+    void fillPixels(uint16_t first, uint16_t count, uint8_t r, uint8_t g, uint8_t b);
+    template<uint8_t C = Channels>
+    typename smoothled::EnableIf<C == 3>::Type fillPixels(uint16_t first, uint16_t count,
+        uint8_t r, uint8_t g, uint8_t b, uint16_t fraction);
+    template<uint8_t C = Channels>
+    typename smoothled::EnableIf<C == 4>::Type fillPixels(uint16_t first, uint16_t count,
+        uint8_t r, uint8_t g, uint8_t b, uint8_t w, uint16_t fraction = 0x8000);
+
+private:
+    // pixels per bulk call in fillPixels, from a buffer on the stack
+    static const uint8_t FillPixels = 8;
+
+    static void arrange(uint8_t* channels, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
+    void fill(uint16_t first, uint16_t count, uint8_t r, uint8_t g, uint8_t b, uint8_t w, uint16_t fraction);
+
+    SmoothLed& m_Leds;
+};
+
+template<class Order>
+inline void SmoothLedPixels<Order>::arrange(uint8_t* channels, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    channels[Order::Red] = r;
+    channels[Order::Green] = g;
+    channels[Order::Blue] = b;
+    if (Channels == 4)
+        channels[Order::White & 3] = w;
+}
+template<class Order>
+inline void SmoothLedPixels<Order>::setPixel(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    uint8_t channels[Channels];
+    arrange(channels, r, g, b, w);
+    m_Leds.set(pixel * Channels, channels, Channels);
+}
+template<class Order>
+inline void SmoothLedPixels<Order>::fadePixel(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+{
+    uint8_t channels[Channels];
+    arrange(channels, r, g, b, w);
+    m_Leds.setFadeTarget(pixel * Channels, channels, Channels);
+}
+template<class Order>
+inline void SmoothLedPixels<Order>::fadePixel(uint16_t pixel, uint8_t r, uint8_t g, uint8_t b, uint8_t w,
+    uint16_t fraction)
+{
+    uint8_t channels[Channels];
+    arrange(channels, r, g, b, w);
+    m_Leds.setFadeTarget(pixel * Channels, channels, Channels, fraction);
+}
+template<class Order>
+inline void SmoothLedPixels<Order>::fillPixels(uint16_t first, uint16_t count, uint8_t r, uint8_t g, uint8_t b)
+{
+    fill(first, count, r, g, b, 0, 0x8000);
+}
+template<class Order>
+template<uint8_t C>
+inline typename smoothled::EnableIf<C == 3>::Type SmoothLedPixels<Order>::fillPixels(uint16_t first,
+    uint16_t count, uint8_t r, uint8_t g, uint8_t b, uint16_t fraction)
+{
+    fill(first, count, r, g, b, 0, fraction);
+}
+template<class Order>
+template<uint8_t C>
+inline typename smoothled::EnableIf<C == 4>::Type SmoothLedPixels<Order>::fillPixels(uint16_t first,
+    uint16_t count, uint8_t r, uint8_t g, uint8_t b, uint8_t w, uint16_t fraction)
+{
+    fill(first, count, r, g, b, w, fraction);
+}
+template<class Order>
+void SmoothLedPixels<Order>::fill(uint16_t first, uint16_t count, uint8_t r, uint8_t g, uint8_t b, uint8_t w,
+    uint16_t fraction)
+{
+    if (count == 0)
+        return;
+    uint8_t channels[FillPixels * Channels];
+    uint8_t n = count < FillPixels ? count : FillPixels;
+    arrange(channels, r, g, b, w);
+    for (uint8_t c = Channels; c < n * Channels; ++c)
+        channels[c] = channels[c - Channels];
+    uint16_t index = first * Channels;
+    do {
+        n = count < FillPixels ? count : FillPixels;
+        m_Leds.setFadeTarget(index, channels, n * Channels, fraction);
+        index += n * Channels;
+        count -= n;
+    } while (count);
+}
@@ -9,18 +9,59 @@ public:
     SmoothLedReceiver() : m_Leds(m_Interpolators, PacketsPerFrame * PacketSize) {}
 
     uint8_t  update(uint8_t minUpdatesPerFrame = 25, uint16_t maxPacketInterval = 250);
+    // Packets can arrive in any order.  The pointer version returns where
+    // to put the packet, or nullptr if it's too late to show.
     uint8_t* receive(uint8_t frame, uint8_t packet, uint8_t idealFrameStart = 0x40);
     void     receive(uint8_t frame, uint8_t packet, const uint8_t* data, uint8_t idealFrameStart = 0x40);
+    // Payload compressed against an earlier frame of the same packet (see
+    // SmoothLedBuffer::decode and extras/packetCodec.py).  Returns false,
+    // dropping the packet, if that frame isn't held any more; the sender
+    // should send a frame relative to nothing every so often to recover.
+    bool     receiveCompressed(uint8_t frame, uint8_t packet, const uint8_t* data, uint8_t length,
+                 uint8_t idealFrameStart = 0x40);
+
+    // How many frames the LEDs carry on fading the same way when the next
+    // frame of a packet hasn't arrived in time, before standing still (1 by
+    // default, 0 to hold straight away).
+    void     setExtrapolation(uint8_t frames);
 
     SmoothLed& getLeds() { return m_Leds; }
+    // the frame being faded from, getLeds().getFadePosition() is how far
+    uint8_t    getFrame() const { return m_Frame; }
+
+    // The playout delay (how far the LEDs run behind the frames received)
+    // is NumBufferedFrames frames.  With adaptive delay turned on before
+    // receiving it follows the measured arrival jitter instead, up to
+    // NumBufferedFrames, which cuts the latency but leaves no spare frame to
+    // cover lost packets.  Both are in 1/256ths of a frame.
+    void     setAdaptiveDelay(bool adaptive) { m_AdaptiveDelay = adaptive; }
+    uint16_t getDelay() const { return m_Delay; }
+    uint16_t getJitter() const { return m_Jitter; }
 
 private:
+    static const uint16_t MaxDelay = NumBufferedFrames << 8;
+    // extra delay on top of the jitter, and the most it moves per frame
+    // received: growing is quicker but still slow enough for the clock
+    // recovery to follow without winding up
+    static const uint8_t DelayMargin = 0x40;
+    static const uint8_t DelayGrowth = 0x20;
+    static const uint8_t DelayShrink = 0x04;
+
+    void     updateClock(uint8_t frame, uint8_t packet, uint8_t idealFrameStart);
+    int16_t  arrivalError(uint8_t frame, uint8_t idealFrameStart) const;
+    void     measureJitter(int16_t error);
+    int16_t  adjustDelay(uint8_t idealFrameStart);
+
     uint8_t m_Frame = 0;
     uint8_t m_UpdateCount = 0;
     uint8_t m_LastReceivedFrame = 0;
     uint8_t m_TimeSinceLastFrame = 0;
     int16_t m_LastError = 0;
     int16_t m_ErrorI = 0;
+    uint16_t m_Delay = MaxDelay;
+    uint16_t m_Jitter = 0;
+    uint8_t m_JitterFraction = 0;
+    bool m_AdaptiveDelay = false;
 
     typedef SmoothLedBuffer<PacketSize, NumBufferedFrames> Buffer;
 
@@ -58,10 +99,33 @@ uint8_t SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::updat
 }
 
 template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
-uint8_t* SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::receive(
+inline uint8_t* SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::receive(
+    uint8_t frame, uint8_t packet, uint8_t idealFrameStart)
+{
+    updateClock(frame, packet, idealFrameStart);
+    return m_Buffer[packet].getWriteBuffer(frame);
+}
+
+template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
+void SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::setExtrapolation(uint8_t frames)
+{
+    for (Buffer& buffer : m_Buffer)
+        buffer.setExtrapolation(frames);
+}
+
+template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
+inline bool SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::receiveCompressed(
+    uint8_t frame, uint8_t packet, const uint8_t* data, uint8_t length, uint8_t idealFrameStart)
+{
+    updateClock(frame, packet, idealFrameStart);
+    return m_Buffer[packet].decode(frame, data, length);
+}
+
+template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
+void SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::updateClock(
     uint8_t frame, uint8_t packet, uint8_t idealFrameStart)
 {
-    uint8_t framesElapsed = frame - m_LastReceivedFrame;
+    int8_t framesElapsed = frame - m_LastReceivedFrame;
     if (framesElapsed > 0 && packet < 3)
     {
         m_LastReceivedFrame = frame;
@@ -75,6 +139,10 @@ uint8_t* SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::rece
                 m_Frame = frame - NumBufferedFrames;
                 m_LastError = 0;
                 m_ErrorI = 0;
+                // start at the longest delay until the jitter is known
+                m_Delay = MaxDelay;
+                m_Jitter = 0;
+                m_JitterFraction = 0;
                 m_Leds.beginFade(frameLength);
                 m_Leds.setFadePosition(idealFrameStart << 8);
                 m_UpdateCount = (idealFrameStart * frameLength) >> 8;
@@ -82,11 +150,20 @@ uint8_t* SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::rece
                     buffer.reset();
             }
         }
-        else 
+        else if (m_TimeSinceLastFrame)
         {
-            uint16_t estimate = ((m_Frame + NumBufferedFrames) << 8) + highByte(m_Leds.getFadePosition() << 1);
-            uint16_t actual = (frame << 8) + idealFrameStart;
-            int16_t error = actual - estimate;
+            // (frames arriving in the same update were held up and released
+            // together on the way, they say nothing about the clock)
+            int16_t error = arrivalError(frame, idealFrameStart);
+            if (m_AdaptiveDelay)
+            {
+                measureJitter(error);
+                // the error takes the delay change and so does the last
+                // error so the differential term doesn't kick
+                int16_t shift = adjustDelay(idealFrameStart);
+                error -= shift;
+                m_LastError -= shift;
+            }
             // proportional error
             fadeRate += error >> 2; 
             // integral error
@@ -99,12 +176,64 @@ uint8_t* SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::rece
         }
         m_TimeSinceLastFrame = 0;
     }
-    return m_Buffer[packet].getWriteBuffer(frame);
+    else if (framesElapsed < 0 && packet == 0 && m_AdaptiveDelay && m_Leds.getFadeRate())
+    {
+        // reordered on the way: too late to steer the clock by but the
+        // delay has to cover it
+        measureJitter(arrivalError(frame, idealFrameStart));
+    }
+}
+
+template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
+int16_t SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::arrivalError(
+    uint8_t frame, uint8_t idealFrameStart) const
+{
+    // the fade position runs from 0 to 0x8000 and can overshoot it until
+    // the next update moves the frame on
+    uint16_t estimate = (m_Frame << 8) + m_Delay + (m_Leds.getFadePosition() >> 7);
+    uint16_t actual = (frame << 8) + idealFrameStart;
+    return actual - estimate;
+}
+
+template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
+void SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::measureJitter(int16_t error)
+{
+    // The clock recovery keeps the average error at zero so a negative
+    // error is how much later than usual the frame arrived.  Follow rises
+    // straight away and let it decay over ~1000 frames so the delay stays
+    // up between bursts.
+    uint32_t lateness = uint32_t(error < 0 ? -error : 0) << 8;
+    uint32_t jitter = (uint32_t(m_Jitter) << 8) | m_JitterFraction;
+    if (lateness >= jitter)
+        jitter = lateness;
+    else
+        jitter -= (jitter - lateness) >> 10;
+    m_Jitter = jitter >> 8;
+    m_JitterFraction = jitter;
+}
+
+template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
+int16_t SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::adjustDelay(uint8_t idealFrameStart)
+{
+    // Each frame has to arrive before the buffers move on to it, a frame
+    // before it is reached.
+    uint16_t delay = 0x100 + idealFrameStart + DelayMargin + m_Jitter;
+    if (delay > MaxDelay)
+        delay = MaxDelay;
+    int16_t shift = delay - m_Delay;
+    if (shift > DelayGrowth)
+        shift = DelayGrowth;
+    else if (shift < -DelayShrink)
+        shift = -DelayShrink;
+    m_Delay += shift;
+    return shift;
 }
 
 template<int PacketsPerFrame, int PacketSize, int NumBufferedFrames>
 inline void SmoothLedReceiver<PacketsPerFrame, PacketSize, NumBufferedFrames>::receive(uint8_t frame, uint8_t packet,
     const uint8_t* data, uint8_t idealFrameStart)
 {
-    memcpy(receive(frame, packet, idealFrameStart), data, PacketSize);
+    uint8_t* buffer = receive(frame, packet, idealFrameStart);
+    if (buffer)
+        memcpy(buffer, data, PacketSize);
 }
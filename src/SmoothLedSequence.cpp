@@ -0,0 +1,89 @@
+#include "SmoothLedSequence.h"
+
+SmoothLedSequence::SmoothLedSequence(SmoothLed& leds, uint16_t startIndex) :
+    m_Leds(leds),
+    m_StartIndex(startIndex),
+    m_NumChannels(0),
+    m_Sequence(nullptr),
+    m_Next(nullptr),
+    m_Keyframe(0),
+    m_Loop(false)
+{
+}
+
+bool SmoothLedSequence::play(const uint8_t* sequence, bool loop)
+{
+    uint16_t numChannels = read16(sequence);
+    uint16_t numInterpolators = m_Leds.getNumInterpolators();
+    if (numChannels == 0 || m_StartIndex > numInterpolators ||
+        numChannels > numInterpolators - m_StartIndex || read16(sequence + 2) == 0)
+    {
+        stop();
+        return false;
+    }
+    m_NumChannels = numChannels;
+    m_Sequence = sequence;
+    m_Next = sequence + 2;
+    m_Keyframe = 0;
+    m_Loop = loop;
+    return true;
+}
+void SmoothLedSequence::stop()
+{
+    m_Next = nullptr;
+}
+
+bool SmoothLedSequence::update()
+{
+    if (!m_Next || m_Leds.isFading())
+        return m_Next != nullptr;
+    uint16_t frames = read16(m_Next);
+    if (frames == 0)
+    {
+        if (!m_Loop)
+        {
+            m_Next = nullptr;
+            return false;
+        }
+        m_Next = m_Sequence + 2;
+        m_Keyframe = 0;
+        frames = read16(m_Next);
+    }
+    m_Next = setTargets(m_Next + 2);
+    ++m_Keyframe;
+    m_Leds.beginFade(frames);
+    return true;
+}
+
+const uint8_t* SmoothLedSequence::setTargets(const uint8_t* runs)
+{
+    uint16_t index = m_StartIndex;
+    uint16_t end = m_StartIndex + m_NumChannels;
+    while (index < end)
+    {
+        uint8_t code = *runs++;
+        uint8_t run = (code & (code & 0x80 ? 0x3f : 0x7f)) + 1;
+        if (code < 0x80)
+        {
+            m_Leds.setFadeTarget(index, runs, run);
+            runs += run;
+        }
+        else if (code < 0xc0)
+        {
+            // stopped where the last fade left them, so the next fade
+            // doesn't move them on again
+            m_Leds.clearFadeTarget(index, run);
+        }
+        else
+        {
+            uint8_t targets[16];
+            uint8_t target = *runs++;
+            for (uint8_t n = 0; n < sizeof(targets); ++n)
+                targets[n] = target;
+            for (uint8_t n = 0; n < run; n += sizeof(targets))
+                m_Leds.setFadeTarget(index + n, targets, min(run - n, int(sizeof(targets))));
+        }
+        index += run;
+    }
+    return runs;
+}
@@ -0,0 +1,62 @@
+// SmoothLED for tinyAVR-0/1 series
+
+#pragma once
+
+#include "SmoothLed.h"
+
+// Plays a keyframe animation straight out of flash, without copying it to
+// SRAM.  A sequence (made by extras/sequenceCodec.py) is the number of
+// channels, little endian, then keyframes of
+//
+//     2 bytes    frames to fade over (little endian), 0 ends the sequence
+//     runs of    0x00-0x7f  code + 1 targets follow, one for each channel
+//                0x80-0xbf  code - 0x7f channels keep the last target
+//                0xc0-0xff  code - 0xbf channels all fade to the next byte
+//
+// making up exactly the number of channels.  The targets are handed to
+// setFadeTarget where they sit, so declare the array plain const: avr-gcc
+// leaves const data in flash on these parts and maps it into the data space
+// (PROGMEM data is not mapped).  The fades use the strip's beginFade timing.
+class SmoothLedSequence
+{
+public:
+    explicit SmoothLedSequence(SmoothLed& leds, uint16_t startIndex = 0);
+
+    // Starts at the first keyframe once any fade in progress has finished.
+    // false if the channels don't fit from startIndex or there are no
+    // keyframes.
+    bool play(const uint8_t* sequence, bool loop = false);
+    void stop();
+    // Call before each leds.update().  Once the current fade has finished
+    // this sets the next keyframe's targets and begins its fade.  Returns
+    // false when the sequence has played to the end.
+    bool update();
+    bool isPlaying() const;
+    uint16_t getKeyframe() const; // the one fading now, from 0 (0 until the first update)
+
+private:
+    // set one keyframe's targets, returns the next keyframe
+    const uint8_t* setTargets(const uint8_t* runs);
+    static uint16_t read16(const uint8_t* data);
+
+    SmoothLed&     m_Leds;
+    uint16_t       m_StartIndex;
+    uint16_t       m_NumChannels;
+    const uint8_t* m_Sequence;
+    const uint8_t* m_Next; // nullptr when stopped
+    uint16_t       m_Keyframe;
+    bool           m_Loop;
+};
+
+inline bool SmoothLedSequence::isPlaying() const
+{
+    return m_Next != nullptr;
+}
+inline uint16_t SmoothLedSequence::getKeyframe() const
+{
+    return m_Keyframe ? m_Keyframe - 1 : 0;
+}
+inline uint16_t SmoothLedSequence::read16(const uint8_t* data)
+{
+    return data[0] | (data[1] << 8);
+}